@@ -0,0 +1,54 @@
+// Runs the CPU side of the per-frame cube path without a browser or GPU, for perf and CI.
+// Usage: Headless [frames] [rings] [maxPointsInCenterRing] [workerCount]
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <cstdlib>
+#include <iostream>
+#include "camera.hpp"
+#include "cubeBatch.hpp"
+#include "jobSystem.hpp"
+#include "profiler.hpp"
+#include "sceneLayout.hpp"
+
+auto main(int argc, char **argv) -> int {
+    const int frames = argc > 1 ? std::atoi(argv[1]) : 1000;
+    const int rings = argc > 2 ? std::atoi(argv[2]) : 200;
+    const int maxPointsInCenterRing = argc > 3 ? std::atoi(argv[3]) : 300;
+    const size_t workerCount = argc > 4 ? std::strtoull(argv[4], nullptr, 10) : JobSystem::DefaultWorkerCount();
+
+    Camera camera;
+    camera.Init(1920, 1080, glm::vec3(0.0f, 0.0f, 0.0f));
+
+    SceneLayout sceneLayout;
+    sceneLayout.BuildSphere(200.0f, rings, maxPointsInCenterRing, 5.0f);
+
+    JobSystem jobSystem(workerCount);
+    CubeBatch batch(CubeInstanceFormat::Compact, sceneLayout.Size());
+    batch.SetJobSystem(&jobSystem);
+    const auto &positions = sceneLayout.GetPositions();
+    const auto &scales = sceneLayout.GetScales();
+
+    size_t visibleCount = 0;
+    for (int frame = 0; frame < frames; ++frame) {
+        Profiler::Get().BeginFrame();
+
+        // Same work as Renderer::Render with sceneAnimatedOnGpu off, minus the upload.
+        {
+            ProfileScope generateScope("Renderer::GenerateInstances");
+            const glm::quat rotation = glm::angleAxis(glm::radians(static_cast<float>(frame)), glm::vec3(0, 1, 0));
+            batch.Add(positions, scales, rotation);
+        }
+
+        camera.ProcessMouseMovement(1, 0);
+        batch.Cull(camera.GetProjectionMatrix() * camera.GetViewMatrix());
+        visibleCount += batch.Size();
+        batch.Clear();
+
+        Profiler::Get().EndFrame();
+    }
+
+    std::cout << sceneLayout.Size() << " instances, " << workerCount << " workers, " << (frames > 0 ? visibleCount / frames : 0) << " visible per frame on average\n";
+    Profiler::Get().WriteSummary(std::cout);
+
+    return EXIT_SUCCESS;
+}
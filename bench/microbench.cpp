@@ -0,0 +1,430 @@
+// Microbenchmarks for the per-instance CPU paths, reported per instance so runs at different sizes compare.
+// Usage: Microbench [maxInstanceCount] [nameFilter]
+#include <glm/ext/matrix_transform.hpp>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <span>
+#include <string_view>
+#include <vector>
+#include "bvh.hpp"
+#include "camera.hpp"
+#include "cubeBatch.hpp"
+#include "drawQueue.hpp"
+#include "frustum.hpp"
+#include "instancePacking.hpp"
+#include "jobSystem.hpp"
+#include "sceneLayout.hpp"
+
+namespace {
+constexpr double minBenchmarkSeconds = 0.1;
+constexpr int minIterations = 3;
+
+// Keeps the compiler from dropping work whose result is never read.
+template <typename T>
+void DoNotOptimize(const T &value) {
+    asm volatile("" : : "r"(&value) : "memory");
+}
+
+struct Options {
+    size_t maxInstanceCount = 1000000;
+    std::string_view filter;
+};
+
+// Runs body until it has taken minBenchmarkSeconds and reports the fastest iteration.
+template <typename Body>
+void Run(const Options &options, const char *name, const size_t instanceCount, const size_t bytesPerInstance, Body &&body) {
+    if (!options.filter.empty() && std::string_view(name).find(options.filter) == std::string_view::npos) {
+        return;
+    }
+
+    double best = INFINITY;
+    double total = 0;
+    for (int iteration = 0; iteration < minIterations || total < minBenchmarkSeconds; ++iteration) {
+        const auto start = std::chrono::steady_clock::now();
+        body();
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        best = std::min(best, seconds);
+        total += seconds;
+    }
+
+    std::printf("%-36s %9zu %12.3f %10zu\n", name, instanceCount, best * 1e9 / static_cast<double>(instanceCount), bytesPerInstance);
+}
+
+// BuildSphere emits about maxPointsInCenterRing^2 / pi instances when rings = maxPointsInCenterRing / 2.
+void BuildSphereWithCount(SceneLayout &layout, const size_t instanceCount) {
+    const int maxPoints = std::max(2, static_cast<int>(std::sqrt(static_cast<double>(instanceCount) * M_PI)));
+    layout.BuildSphere(200.0f, maxPoints / 2, maxPoints, 5.0f);
+}
+
+// Entry distance of a ray into a sphere's bounding box, the per-item test of the linear baseline for Bvh::Raycast.
+auto RaycastSphereBox(const glm::vec3 origin, const glm::vec3 direction, const glm::vec4 sphere) -> float {
+    float enter = 0.0f;
+    float exit = INFINITY;
+    for (int axis = 0; axis < 3; ++axis) {
+        const float t0 = (sphere[axis] - sphere.w - origin[axis]) / direction[axis];
+        const float t1 = (sphere[axis] + sphere.w - origin[axis]) / direction[axis];
+        enter = std::max(enter, std::min(t0, t1));
+        exit = std::min(exit, std::max(t0, t1));
+    }
+    return enter <= exit ? enter : INFINITY;
+}
+
+auto RaycastLinear(std::span<const glm::vec4> spheres, const glm::vec3 origin, const glm::vec3 direction) -> float {
+    float nearest = INFINITY;
+    for (const auto &sphere : spheres) {
+        nearest = std::min(nearest, RaycastSphereBox(origin, direction, sphere));
+    }
+    return nearest;
+}
+
+void BenchmarkSize(const Options &options, JobSystem &jobSystem, const size_t requestedCount) {
+    SceneLayout layout;
+    BuildSphereWithCount(layout, requestedCount);
+    const size_t count = layout.Size();
+    const auto &positions = layout.GetPositions();
+    const auto &scales = layout.GetScales();
+    const glm::quat rotation = glm::angleAxis(glm::radians(30.0f), glm::vec3(0, 1, 0));
+
+    Run(options, "SceneLayout::BuildSphere", count, sizeof(glm::vec3) + sizeof(float), [&] {
+        SceneLayout sphere;
+        BuildSphereWithCount(sphere, requestedCount);
+        DoNotOptimize(sphere.Size());
+    });
+
+    // Composition chain the sphere loop in Renderer::Render used before the layout was cached.
+    std::vector<glm::mat4x4> matrices(count);
+    Run(options, "Matrix translate*rotate*scale", count, sizeof(glm::mat4x4), [&] {
+        for (size_t i = 0; i < count; ++i) {
+            matrices[i] = glm::translate(glm::mat4x4(1.0f), positions[i])
+                        * glm::rotate(glm::mat4x4(1.0f), glm::radians(30.0f), glm::vec3(0, 1, 0))
+                        * glm::scale(glm::mat4x4(1.0f), glm::vec3(scales[i]));
+        }
+        DoNotOptimize(matrices);
+    });
+
+    Run(options, "Matrix direct construction", count, sizeof(glm::mat4x4), [&] {
+        const glm::mat3x3 rotationMatrix = glm::mat3_cast(rotation);
+        for (size_t i = 0; i < count; ++i) {
+            glm::mat4x4 transform = glm::mat4x4(rotationMatrix * scales[i]);
+            transform[3] = glm::vec4(positions[i], 1.0f);
+            matrices[i] = transform;
+        }
+        DoNotOptimize(matrices);
+    });
+
+    Run(options, "BuildInstanceMatrices", count, sizeof(glm::mat4x4), [&] {
+        BuildInstanceMatrices(positions, scales, rotation, matrices);
+        DoNotOptimize(matrices);
+    });
+
+    // Graphics::DrawRect forwards to CubeBatch::Add.
+    CubeBatch matrixBatch(CubeInstanceFormat::ModelMatrix, count);
+    Run(options, "CubeBatch::Add ModelMatrix", count, sizeof(glm::mat4x4), [&] {
+        matrixBatch.Clear();
+        for (size_t i = 0; i < count; ++i) {
+            matrixBatch.Add(positions[i], rotation, scales[i]);
+        }
+        DoNotOptimize(matrixBatch.GetModelMatrices());
+    });
+
+    Run(options, "CubeBatch::Add ModelMatrix batch", count, sizeof(glm::mat4x4), [&] {
+        matrixBatch.Clear();
+        matrixBatch.Add(positions, scales, rotation);
+        DoNotOptimize(matrixBatch.GetModelMatrices());
+    });
+
+    CubeBatch compactBatch(CubeInstanceFormat::Compact, count);
+    Run(options, "CubeBatch::Add Compact", count, sizeof(CompactCubeInstance), [&] {
+        compactBatch.Clear();
+        for (size_t i = 0; i < count; ++i) {
+            compactBatch.Add(positions[i], rotation, scales[i]);
+        }
+        DoNotOptimize(compactBatch.GetCompactInstances());
+    });
+
+    Run(options, "CubeBatch::Add Compact batch", count, sizeof(CompactCubeInstance), [&] {
+        compactBatch.Clear();
+        compactBatch.Add(positions, scales, rotation);
+        DoNotOptimize(compactBatch.GetCompactInstances());
+    });
+
+    // Packing done before CubeShader::UpdateBuffers when DrawRect is given a full matrix.
+    std::vector<CompactCubeInstance> packed(count);
+    Run(options, "PackCompactCubeInstance matrix", count, sizeof(CompactCubeInstance), [&] {
+        for (size_t i = 0; i < count; ++i) {
+            packed[i] = PackCompactCubeInstance(matrices[i]);
+        }
+        DoNotOptimize(packed);
+    });
+
+    CubeBatch threadedBatch(CubeInstanceFormat::Compact, count);
+    threadedBatch.SetJobSystem(&jobSystem);
+    Run(options, "CubeBatch::Add Compact batch jobs", count, sizeof(CompactCubeInstance), [&] {
+        threadedBatch.Clear();
+        threadedBatch.Add(positions, scales, rotation);
+        DoNotOptimize(threadedBatch.GetCompactInstances());
+    });
+
+    Camera camera;
+    camera.Init(1920, 1080, glm::vec3(0.0f));
+    const glm::mat4x4 viewProjectionMatrix = camera.GetProjectionMatrix() * camera.GetViewMatrix();
+    Run(options, "CubeBatch::Cull Compact", count, sizeof(CompactCubeInstance), [&] {
+        compactBatch.Clear();
+        for (size_t i = 0; i < count; ++i) {
+            compactBatch.Add(positions[i], rotation, scales[i]);
+        }
+        compactBatch.Cull(viewProjectionMatrix);
+        DoNotOptimize(compactBatch.Size());
+    });
+
+    Run(options, "CubeBatch::Cull Compact jobs", count, sizeof(CompactCubeInstance), [&] {
+        threadedBatch.Clear();
+        threadedBatch.Add(positions, scales, rotation);
+        threadedBatch.Cull(viewProjectionMatrix);
+        DoNotOptimize(threadedBatch.Size());
+    });
+
+    // Graphics::Update splits every culled batch with an impostor level, the default for registered meshes.
+    CubeBatch impostorBatch(CubeInstanceFormat::Compact, count);
+    const float screenScale = GetScreenScale(camera.GetProjectionMatrix(), 1080.0f);
+    const std::array<float, 1> impostorScreenSizes{4.0f};
+    const std::array<CubeBatch *, 1> impostorLevels{&impostorBatch};
+    Run(options, "CubeBatch::SplitByScreenSize Compact", count, sizeof(CompactCubeInstance), [&] {
+        compactBatch.Clear();
+        impostorBatch.Clear();
+        compactBatch.Add(positions, scales, rotation);
+        compactBatch.SplitByScreenSize(viewProjectionMatrix, screenScale, cubeBoundingRadius, impostorScreenSizes, impostorLevels);
+        DoNotOptimize(impostorBatch.Size());
+    });
+
+    Run(options, "CubeBatch::SortFrontToBack Compact", count, sizeof(CompactCubeInstance), [&] {
+        compactBatch.Clear();
+        compactBatch.Add(positions, scales, rotation);
+        compactBatch.SortFrontToBack(viewProjectionMatrix);
+        DoNotOptimize(compactBatch.GetCompactInstances());
+    });
+
+    std::vector<glm::vec4> spheres(count);
+    for (size_t i = 0; i < count; ++i) {
+        spheres[i] = glm::vec4(positions[i], scales[i] * cubeBoundingRadius);
+    }
+    Bvh bvh;
+    Run(options, "Bvh::Build", count, sizeof(glm::vec4), [&] {
+        bvh.Build(spheres);
+        DoNotOptimize(bvh.GetNodeCount());
+    });
+
+    Bvh threadedBvh;
+    threadedBvh.SetJobSystem(&jobSystem);
+    Run(options, "Bvh::Build jobs", count, sizeof(glm::vec4), [&] {
+        threadedBvh.Build(spheres);
+        DoNotOptimize(threadedBvh.GetNodeCount());
+    });
+
+    Run(options, "Bvh::Refit", count, sizeof(glm::vec4), [&] {
+        bvh.Refit(spheres);
+        DoNotOptimize(bvh.GetNodeCount());
+    });
+
+    const Frustum frustum = ExtractFrustum(viewProjectionMatrix);
+    std::vector<uint32_t> visibleItems;
+    Run(options, "Bvh::QueryFrustum", count, sizeof(glm::vec4), [&] {
+        visibleItems.clear();
+        bvh.QueryFrustum(frustum, visibleItems);
+        DoNotOptimize(visibleItems.size());
+    });
+
+    // Rays from the sphere's center out through its shell, as picking from the camera would.
+    constexpr size_t rayCount = 64;
+    std::vector<glm::vec3> rayDirections(rayCount);
+    for (size_t i = 0; i < rayCount; ++i) {
+        rayDirections[i] = glm::normalize(positions[i * count / rayCount]);
+    }
+    Run(options, "Bvh::Raycast x64", count, sizeof(glm::vec4), [&] {
+        for (const auto &direction : rayDirections) {
+            DoNotOptimize(bvh.Raycast(glm::vec3(0.0f), direction));
+        }
+    });
+
+    // What a click costs, from pixel to instance.
+    const glm::mat4x4 viewMatrix = camera.GetViewMatrix();
+    const glm::mat4x4 projectionMatrix = camera.GetProjectionMatrix();
+    Run(options, "Pointer pick", count, sizeof(glm::vec4), [&] {
+        const Ray ray = GetPointerRay(viewMatrix, projectionMatrix, glm::vec2(960.0f, 540.0f), glm::vec2(1920.0f, 1080.0f));
+        DoNotOptimize(bvh.Raycast(ray.origin, ray.direction));
+    });
+
+    Run(options, "Linear raycast x64", count, sizeof(glm::vec4), [&] {
+        for (const auto &direction : rayDirections) {
+            DoNotOptimize(RaycastLinear(spheres, glm::vec3(0.0f), direction));
+        }
+    });
+}
+
+// Adding or removing static meshes rebuilds the scene index inside Graphics::Update, at 1M items that has to stay a hitch of a few frames.
+constexpr double bvhBuildBudgetMilliseconds = 100.0;
+constexpr size_t bvhBuildBudgetCount = 1000000;
+
+// Whole-build time of the scene index on the job system at bvhBuildBudgetCount items, the fastest of a few builds.
+void ReportBvhBuildBudget(const Options &options, JobSystem &jobSystem) {
+    // Bounded by the size argument like every other benchmark.
+    if (options.maxInstanceCount < bvhBuildBudgetCount || (!options.filter.empty() && std::string_view("Bvh::Build budget").find(options.filter) == std::string_view::npos)) {
+        return;
+    }
+
+    SceneLayout layout;
+    BuildSphereWithCount(layout, bvhBuildBudgetCount);
+    std::vector<glm::vec4> spheres(layout.Size());
+    for (size_t i = 0; i < layout.Size(); ++i) {
+        spheres[i] = glm::vec4(layout.GetPositions()[i], layout.GetScales()[i] * cubeBoundingRadius);
+    }
+
+    Bvh bvh;
+    bvh.SetJobSystem(&jobSystem);
+    double best = INFINITY;
+    for (int iteration = 0; iteration < minIterations; ++iteration) {
+        const auto start = std::chrono::steady_clock::now();
+        bvh.Build(spheres);
+        best = std::min(best, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        DoNotOptimize(bvh.GetNodeCount());
+    }
+
+    std::printf("%-36s %9zu %12.3f %12.3f %s (%zu threads)\n", "Bvh::Build jobs", spheres.size(), best, bvhBuildBudgetMilliseconds, best <= bvhBuildBudgetMilliseconds ? "within" : "OVER", jobSystem.GetWorkerCount() + 1);
+}
+
+enum class DepthTest {
+    Less,   // Color pass with depth writes, also the depth-only pass of a pre-pass
+    Equal,  // Shading pass after a pre-pass, depth already final and not written
+};
+
+struct FragmentLoad {
+    size_t rasterized = 0;  // Fragments reaching the depth test
+    size_t passed = 0;      // Fragments passing it, each one runs the fragment shader in a color pass
+};
+
+// Coarse software model of early-Z: each instance is rasterized as the front surface of its bounding sphere,
+// a disc over its projected radius, in submission order, into depthBuffer.
+auto RasterizeDepth(const std::vector<CompactCubeInstance> &instances, const glm::mat4x4 &projectionMatrix, const glm::mat4x4 &viewProjectionMatrix, const DepthTest depthTest, std::vector<float> &depthBuffer) -> FragmentLoad {
+    constexpr int width = 320;
+    constexpr int height = 180;
+    depthBuffer.resize(static_cast<size_t>(width * height), INFINITY);
+
+    FragmentLoad load;
+    for (const auto &instance : instances) {
+        const glm::vec4 clip = viewProjectionMatrix * glm::vec4(instance.translation, 1.0f);
+        const float radius = std::abs(instance.scale) * cubeBoundingRadius;
+        if (clip.w <= radius) {
+            continue;
+        }
+        const float pixelRadius = radius * projectionMatrix[1][1] / clip.w * height * 0.5f;
+        const float centerX = (clip.x / clip.w * 0.5f + 0.5f) * width;
+        const float centerY = (clip.y / clip.w * 0.5f + 0.5f) * height;
+        const int minX = std::max(0, static_cast<int>(centerX - pixelRadius));
+        const int maxX = std::min(width - 1, static_cast<int>(centerX + pixelRadius));
+        const int minY = std::max(0, static_cast<int>(centerY - pixelRadius));
+        const int maxY = std::min(height - 1, static_cast<int>(centerY + pixelRadius));
+
+        for (int y = minY; y <= maxY; ++y) {
+            for (int x = minX; x <= maxX; ++x) {
+                const float dx = (static_cast<float>(x) + 0.5f - centerX) / pixelRadius;
+                const float dy = (static_cast<float>(y) + 0.5f - centerY) / pixelRadius;
+                const float inside = 1.0f - dx * dx - dy * dy;
+                if (inside < 0.0f) {
+                    continue;
+                }
+                const float fragmentDepth = clip.w - radius * std::sqrt(inside);
+                float &depth = depthBuffer[static_cast<size_t>(y * width + x)];
+                load.rasterized++;
+                if (depthTest == DepthTest::Less && fragmentDepth < depth) {
+                    depth = fragmentDepth;
+                    load.passed++;
+                } else if (depthTest == DepthTest::Equal && fragmentDepth == depth) {
+                    load.passed++;
+                }
+            }
+        }
+    }
+    return load;
+}
+
+// Fragment shader invocations and depth tests per covered pixel for each ordering, seen from off-centre
+// like VerifyFrontToBackSort so the sphere's far side is behind its near side.
+// Not a timing, the GPU side of the comparison is the GPU::RenderPass profiler scope with the runtime toggles.
+void ReportFragmentLoad(const Options &options, const size_t requestedCount) {
+    if (!options.filter.empty() && std::string_view("FragmentLoad").find(options.filter) == std::string_view::npos) {
+        return;
+    }
+
+    SceneLayout layout;
+    BuildSphereWithCount(layout, requestedCount);
+    Camera camera;
+    camera.Init(1920, 1080, glm::vec3(0.0f, 0.0f, 150.0f));
+    const glm::mat4x4 projectionMatrix = camera.GetProjectionMatrix();
+    const glm::mat4x4 viewProjectionMatrix = projectionMatrix * camera.GetViewMatrix();
+
+    CubeBatch sorted(CubeInstanceFormat::Compact, layout.Size());
+    sorted.Add(layout.GetPositions(), layout.GetScales(), glm::quat(1.0f, 0.0f, 0.0f, 0.0f));
+    sorted.Cull(viewProjectionMatrix);
+    sorted.SortFrontToBack(viewProjectionMatrix);
+    const std::vector<CompactCubeInstance> &frontToBack = sorted.GetCompactInstances();
+    // The layout order follows the sphere's rings, which happens to be favourable, so submit in no order at all.
+    std::vector<CompactCubeInstance> submitted(frontToBack);
+    std::shuffle(submitted.begin(), submitted.end(), std::mt19937(42));
+    // Worst case for early-Z.
+    const std::vector<CompactCubeInstance> backToFront(frontToBack.rbegin(), frontToBack.rend());
+
+    size_t covered = 1;
+    const auto report = [&](const char *name, const size_t shaded, const size_t depthTested) {
+        std::printf("%-36s %9zu %12.3f %12.3f\n", name, frontToBack.size(), static_cast<double>(shaded) / static_cast<double>(covered), static_cast<double>(depthTested) / static_cast<double>(covered));
+    };
+    const auto reportColorPass = [&](const char *name, const std::vector<CompactCubeInstance> &instances) {
+        std::vector<float> depthBuffer;
+        const FragmentLoad load = RasterizeDepth(instances, projectionMatrix, viewProjectionMatrix, DepthTest::Less, depthBuffer);
+        covered = std::max<size_t>(1, static_cast<size_t>(std::count_if(depthBuffer.begin(), depthBuffer.end(), [](const float depth) { return depth != INFINITY; })));
+        report(name, load.passed, load.rasterized);
+    };
+    reportColorPass("Submission order", submitted);
+    reportColorPass("Back to front", backToFront);
+    reportColorPass("SortFrontToBack", frontToBack);
+
+    // Depth-only pass, then a color pass with an equal test against the finished depth buffer, both in submission order.
+    std::vector<float> depthBuffer;
+    const FragmentLoad depthOnly = RasterizeDepth(submitted, projectionMatrix, viewProjectionMatrix, DepthTest::Less, depthBuffer);
+    const FragmentLoad shading = RasterizeDepth(submitted, projectionMatrix, viewProjectionMatrix, DepthTest::Equal, depthBuffer);
+    report("Depth pre-pass", shading.passed, depthOnly.rasterized + shading.rasterized);
+}
+}  // namespace
+
+auto main(int argc, char **argv) -> int {
+    Options options;
+    if (argc > 1) {
+        options.maxInstanceCount = std::strtoull(argv[1], nullptr, 10);
+    }
+    if (argc > 2) {
+        options.filter = argv[2];
+    }
+
+    JobSystem jobSystem(JobSystem::DefaultWorkerCount());
+
+    std::printf("%-36s %9s %12s %10s\n", "benchmark", "instances", "ns/instance", "bytes/inst");
+    for (size_t count = 1000; count <= options.maxInstanceCount; count *= 10) {
+        BenchmarkSize(options, jobSystem, count);
+    }
+
+    std::printf("\n%-36s %9s %12s %12s\n", "build budget", "instances", "ms", "budget ms");
+    ReportBvhBuildBudget(options, jobSystem);
+
+    std::printf("\n%-36s %9s %12s %12s\n", "fragment load", "instances", "shaded/px", "tested/px");
+    for (size_t count = 1000; count <= options.maxInstanceCount; count *= 10) {
+        ReportFragmentLoad(options, count);
+    }
+
+    return EXIT_SUCCESS;
+}
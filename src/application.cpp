@@ -3,8 +3,10 @@
 #include <emscripten/emscripten.h>
 #include <emscripten/html5.h>
 #include <webgpu/webgpu_cpp.h>
+#include <cstring>
 #include <iostream>
 #include "glm/fwd.hpp"
+#include "profiler.hpp"
 #include "renderer.hpp"
 
 void Application::GetCanvasSize(uint32_t &width, uint32_t &height) {
@@ -40,6 +42,8 @@ auto Application::OnTouchStartCallback(int /*eventType*/, const EmscriptenTouchE
 
     app->lastTouchPoint.x = touchEvent->touches[0].targetX;
     app->lastTouchPoint.y = touchEvent->touches[0].targetY;
+    app->pickRequested = true;
+    app->pickPoint = app->lastTouchPoint;
 
     return EM_TRUE;
 }
@@ -56,8 +60,18 @@ auto Application::OnTouchMoveCallback(int /*eventType*/, const EmscriptenTouchEv
     return EM_TRUE;
 }
 
-auto Application::OnMouseButtonCallback(int /*eventType*/, const EmscriptenMouseEvent * /*mouseEvent*/, void *userData) -> EM_BOOL {
-    const auto *app = static_cast<const Application *>(userData);
+auto Application::OnMouseButtonCallback(int eventType, const EmscriptenMouseEvent *mouseEvent, void *userData) -> EM_BOOL {
+    auto *app = static_cast<Application *>(userData);
+
+    // A locked pointer stays put while the view turns, so the crosshair at the center is what is aimed at.
+    // The click that locks the pointer only does that, and only the primary button picks.
+    if (eventType == EMSCRIPTEN_EVENT_MOUSEDOWN && mouseEvent->button == 0 && app->isMousePointerLocked) {
+        uint32_t width = 0;
+        uint32_t height = 0;
+        Application::GetCanvasSize(width, height);
+        app->pickRequested = true;
+        app->pickPoint = Point{.x = (int)width / 2, .y = (int)height / 2};
+    }
 
     if (!app->isMousePointerLocked) {
         int result = emscripten_request_pointerlock("#canvas", EM_FALSE);
@@ -65,8 +79,26 @@ auto Application::OnMouseButtonCallback(int /*eventType*/, const EmscriptenMouse
 
     return true;
 }
-auto Application::OnKeyPressCallback(int /*eventType*/, const EmscriptenKeyboardEvent * /*keyEvent*/, void *userData) -> EM_BOOL {
-    const auto *app = static_cast<const Application *>(userData);
+auto Application::OnKeyPressCallback(int /*eventType*/, const EmscriptenKeyboardEvent *keyEvent, void *userData) -> EM_BOOL {
+    auto *app = static_cast<Application *>(userData);
+
+    // Dump the profiler to the browser console.
+    if (std::strcmp(keyEvent->key, "p") == 0) {
+        Profiler::Get().WriteSummary(std::cout);
+        Profiler::Get().WriteChromeTrace(std::cout);
+        std::cout << std::flush;
+        return true;
+    }
+
+    // Compare fragment load with the GPU::RenderPass timing.
+    if (std::strcmp(keyEvent->key, "z") == 0) {
+        app->renderer.SetDepthPrePass(!app->renderer.IsDepthPrePassEnabled());
+        return true;
+    }
+    if (std::strcmp(keyEvent->key, "o") == 0) {
+        app->renderer.SetFrontToBackSorting(!app->renderer.IsFrontToBackSortingEnabled());
+        return true;
+    }
 
     emscripten_exit_pointerlock();
 
@@ -96,6 +128,7 @@ auto Application::Initialize() -> bool {
     uint32_t height = 0;
     this->GetCanvasSize(width, height);
 
+    this->camera.SetReverseZ(this->renderer.IsReverseZ());
     this->camera.Init(width, height, glm::vec3(0.0f, 0.0f, 0.0f));
 
     return this->InitializeMouseMovement()
@@ -126,14 +159,31 @@ void Application::Start() {
         this, 0, (int)true);
 }
 
+void Application::PickInstance() {
+    const glm::vec2 pointer((float)this->pickPoint.x, (float)this->pickPoint.y);
+    this->renderer.PickInstance(this->camera.GetViewMatrix(), this->camera.GetProjectionMatrix(), pointer);
+}
+
 void Application::MainLoop() {
-    glfwPollEvents();
+    Profiler::Get().BeginFrame();
+
+    {
+        ProfileScope profileScope("Application::PollEvents");
+        glfwPollEvents();
+    }
     auto time = static_cast<float>(glfwGetTime());
 
     this->camera.ProcessMouseMovement(this->mouseDeltaThisFrame.movementX, this->mouseDeltaThisFrame.movementY);
 
+    if (this->pickRequested) {
+        this->PickInstance();
+        this->pickRequested = false;
+    }
+
     this->renderer.Render(this->camera.GetViewMatrix(), this->camera.GetProjectionMatrix(), time);
 
     this->mouseDeltaThisFrame.movementX = 0;
     this->mouseDeltaThisFrame.movementY = 0;
+
+    Profiler::Get().EndFrame();
 }
\ No newline at end of file
@@ -34,16 +34,20 @@ class Application {
     bool isMousePointerLocked = false;
     MouseDelta mouseDeltaThisFrame = MouseDelta{.movementX = 0, .movementY = 0};
     Point lastTouchPoint = Point();
+    // Set by the click and touch callbacks, resolved in MainLoop against the camera of that frame.
+    bool pickRequested = false;
+    Point pickPoint = Point();
 
     static void GetCanvasSize(uint32_t &width, uint32_t &height);
     static auto OnTouchStartCallback(int eventType, const EmscriptenTouchEvent *touchEvent, void *userData) -> EM_BOOL;
     static auto OnTouchMoveCallback(int eventType, const EmscriptenTouchEvent *touchEvent, void *userData) -> EM_BOOL;
     static auto OnPointerLockChangeCallback(int /*eventType*/, const EmscriptenPointerlockChangeEvent *emscEvent, void *userData) -> EM_BOOL;
     static auto OnMouseMoveCallback(int /*eventType*/, const EmscriptenMouseEvent * /*mouseEvent*/, void *userData) -> EM_BOOL;
-    static auto OnMouseButtonCallback(int /*eventType*/, const EmscriptenMouseEvent * /*mouseEvent*/, void *userData) -> EM_BOOL;
-    static auto OnKeyPressCallback(int /*eventType*/, const EmscriptenKeyboardEvent * /*keyEvent*/, void *userData) -> EM_BOOL;
+    static auto OnMouseButtonCallback(int eventType, const EmscriptenMouseEvent *mouseEvent, void *userData) -> EM_BOOL;
+    static auto OnKeyPressCallback(int /*eventType*/, const EmscriptenKeyboardEvent *keyEvent, void *userData) -> EM_BOOL;
     auto InitializeMouseMovement() -> bool;
     void Resize(uint32_t width, uint32_t height);
+    void PickInstance();
     void MainLoop();
     static auto InitGlfw() -> bool;
 };
@@ -0,0 +1,484 @@
+#include "bvh.hpp"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <numeric>
+#include "profiler.hpp"
+
+namespace {
+constexpr int binCount = 12;
+// Nodes with fewer items bin on the calling thread, the dispatch would cost more than it saves.
+constexpr size_t parallelBinChunkSize = 16384;
+
+struct StackEntry {
+    uint32_t node;
+    float distance;  // Lower bound for anything in the node, entries past the best hit are skipped
+};
+
+auto SurfaceArea(const glm::vec3 boundsMin, const glm::vec3 boundsMax) -> float {
+    const glm::vec3 extent = boundsMax - boundsMin;
+    return 2.0f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+}
+
+auto Min(const glm::vec3 a, const glm::vec3 b) -> glm::vec3 {
+    return glm::vec3(std::min(a.x, b.x), std::min(a.y, b.y), std::min(a.z, b.z));
+}
+
+auto Max(const glm::vec3 a, const glm::vec3 b) -> glm::vec3 {
+    return glm::vec3(std::max(a.x, b.x), std::max(a.y, b.y), std::max(a.z, b.z));
+}
+
+// Slab test, distance the ray enters the box at or INFINITY when it misses within maxDistance.
+auto IntersectBox(const glm::vec3 origin, const glm::vec3 inverseDirection, const glm::vec3 boundsMin, const glm::vec3 boundsMax, const float maxDistance) -> float {
+    const glm::vec3 t0 = (boundsMin - origin) * inverseDirection;
+    const glm::vec3 t1 = (boundsMax - origin) * inverseDirection;
+    const glm::vec3 near = Min(t0, t1);
+    const glm::vec3 far = Max(t0, t1);
+    const float enter = std::max({near.x, near.y, near.z, 0.0f});
+    const float exit = std::min({far.x, far.y, far.z, maxDistance});
+    return enter <= exit ? enter : INFINITY;
+}
+
+auto DistanceSquaredToBox(const glm::vec3 point, const glm::vec3 boundsMin, const glm::vec3 boundsMax) -> float {
+    const glm::vec3 outside = Max(Max(boundsMin - point, point - boundsMax), glm::vec3(0.0f));
+    return glm::dot(outside, outside);
+}
+
+struct Bin {
+    glm::vec3 boundsMin{INFINITY};
+    glm::vec3 boundsMax{-INFINITY};
+    uint32_t count = 0;
+};
+
+void Grow(Bin &bin, const Bin &other) {
+    bin.boundsMin = Min(bin.boundsMin, other.boundsMin);
+    bin.boundsMax = Max(bin.boundsMax, other.boundsMax);
+    bin.count += other.count;
+}
+
+// Accumulates [0, count) into a T, in chunks on jobSystem when there is more than one chunk, then combines the partial results.
+template <typename T, typename Accumulate, typename Combine>
+auto Reduce(JobSystem *jobSystem, const size_t count, const Accumulate &accumulate, const Combine &combine) -> T {
+    T result{};
+    if (jobSystem == nullptr || count <= parallelBinChunkSize) {
+        accumulate(result, 0, count);
+        return result;
+    }
+
+    std::vector<T> partials((count + parallelBinChunkSize - 1) / parallelBinChunkSize);
+    jobSystem->ParallelFor(count, parallelBinChunkSize, [&](const size_t begin, const size_t end) {
+        accumulate(partials[begin / parallelBinChunkSize], begin, end);
+    });
+    for (const T &partial : partials) {
+        combine(result, partial);
+    }
+    return result;
+}
+
+enum class Containment {
+    Outside,
+    Intersecting,
+    Inside,
+};
+
+auto ClassifyBox(const Frustum &frustum, const glm::vec3 boundsMin, const glm::vec3 boundsMax) -> Containment {
+    Containment containment = Containment::Inside;
+    for (const auto &plane : frustum.planes) {
+        // The corners furthest along and against the plane normal.
+        const glm::vec3 positive(plane.x >= 0 ? boundsMax.x : boundsMin.x, plane.y >= 0 ? boundsMax.y : boundsMin.y, plane.z >= 0 ? boundsMax.z : boundsMin.z);
+        const glm::vec3 negative(plane.x >= 0 ? boundsMin.x : boundsMax.x, plane.y >= 0 ? boundsMin.y : boundsMax.y, plane.z >= 0 ? boundsMin.z : boundsMax.z);
+        if (glm::dot(glm::vec3(plane), positive) + plane.w < 0) {
+            return Containment::Outside;
+        }
+        if (glm::dot(glm::vec3(plane), negative) + plane.w < 0) {
+            containment = Containment::Intersecting;
+        }
+    }
+    return containment;
+}
+}  // namespace
+
+void Bvh::Build(std::span<const glm::vec4> spheres) {
+    ProfileScope profileScope("Bvh::Build");
+
+    this->spheres.assign(spheres.begin(), spheres.end());
+    this->itemOrder.resize(spheres.size());
+    std::iota(this->itemOrder.begin(), this->itemOrder.end(), 0u);
+    this->buildSpheres.assign(spheres.begin(), spheres.end());
+    this->nodes.clear();
+    if (spheres.empty()) {
+        return;
+    }
+
+    this->nodes.reserve(spheres.size() * 2);
+    this->nodes.push_back(BvhNode{.leftOrFirst = 0, .count = (uint32_t)spheres.size()});
+    this->UpdateLeafBounds(this->nodes[0]);
+
+    if (this->jobSystem == nullptr || this->jobSystem->GetWorkerCount() == 0) {
+        this->BuildSubtree(this->nodes, 0);
+        return;
+    }
+
+    // Split the largest pending node, binning across the workers, until there are a few subtrees per thread.
+    const size_t subtreeCount = (this->jobSystem->GetWorkerCount() + 1) * 4;
+    std::vector<uint32_t> subtrees{0};
+    while (subtrees.size() < subtreeCount) {
+        const auto largest = std::max_element(subtrees.begin(), subtrees.end(), [&](const uint32_t a, const uint32_t b) {
+            return this->nodes[a].count < this->nodes[b].count;
+        });
+        const uint32_t nodeIndex = *largest;
+        if (this->nodes[nodeIndex].count <= Bvh::minParallelSubtreeSize) {
+            break;
+        }
+        subtrees.erase(largest);
+        if (this->Subdivide(this->nodes, nodeIndex, this->jobSystem)) {
+            subtrees.push_back(this->nodes[nodeIndex].leftOrFirst);
+            subtrees.push_back(this->nodes[nodeIndex].leftOrFirst + 1);
+        }
+    }
+
+    // Each subtree builds into its own array from a copy of its root, the item ranges they reorder are disjoint.
+    std::vector<std::vector<BvhNode>> subtreeNodes(subtrees.size());
+    this->jobSystem->ParallelFor(subtrees.size(), 1, [&](const size_t begin, const size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            subtreeNodes[i].reserve(this->nodes[subtrees[i]].count * 2);
+            subtreeNodes[i].push_back(this->nodes[subtrees[i]]);
+            this->BuildSubtree(subtreeNodes[i], 0);
+        }
+    });
+
+    // Appended after everything above them, so children still follow their parents as Refit expects.
+    for (size_t i = 0; i < subtrees.size(); ++i) {
+        const auto offset = (uint32_t)this->nodes.size() - 1;  // Local index 0 replaces the root already in nodes
+        for (auto &node : subtreeNodes[i]) {
+            if (node.count == 0) {
+                node.leftOrFirst += offset;
+            }
+        }
+        this->nodes[subtrees[i]] = subtreeNodes[i][0];
+        this->nodes.insert(this->nodes.end(), subtreeNodes[i].begin() + 1, subtreeNodes[i].end());
+    }
+}
+
+void Bvh::BuildSubtree(std::vector<BvhNode> &nodes, const uint32_t rootIndex) {
+    std::vector<uint32_t> stack{rootIndex};
+    while (!stack.empty()) {
+        const uint32_t nodeIndex = stack.back();
+        stack.pop_back();
+        if (this->Subdivide(nodes, nodeIndex, nullptr)) {
+            stack.push_back(nodes[nodeIndex].leftOrFirst);
+            stack.push_back(nodes[nodeIndex].leftOrFirst + 1);
+        }
+    }
+}
+
+void Bvh::UpdateLeafBounds(BvhNode &node) const {
+    node.boundsMin = glm::vec3(INFINITY);
+    node.boundsMax = glm::vec3(-INFINITY);
+    for (uint32_t i = node.leftOrFirst; i < node.leftOrFirst + node.count; ++i) {
+        const glm::vec4 &sphere = this->spheres[this->itemOrder[i]];
+        node.boundsMin = Min(node.boundsMin, glm::vec3(sphere) - glm::vec3(sphere.w));
+        node.boundsMax = Max(node.boundsMax, glm::vec3(sphere) + glm::vec3(sphere.w));
+    }
+}
+
+auto Bvh::Subdivide(std::vector<BvhNode> &nodes, const uint32_t nodeIndex, JobSystem *jobSystem) -> bool {
+    const BvhNode node = nodes[nodeIndex];  // Copied, the children may reallocate nodes
+    if (node.count <= Bvh::maxLeafSize) {
+        return false;
+    }
+
+    const glm::vec4 *spheres = this->buildSpheres.data() + node.leftOrFirst;
+
+    struct CentroidBounds {
+        glm::vec3 min{INFINITY};
+        glm::vec3 max{-INFINITY};
+    };
+    const auto centroids = Reduce<CentroidBounds>(
+        jobSystem, node.count,
+        [&](CentroidBounds &bounds, const size_t begin, const size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                bounds.min = Min(bounds.min, glm::vec3(spheres[i]));
+                bounds.max = Max(bounds.max, glm::vec3(spheres[i]));
+            }
+        },
+        [](CentroidBounds &bounds, const CentroidBounds &other) {
+            bounds.min = Min(bounds.min, other.min);
+            bounds.max = Max(bounds.max, other.max);
+        });
+
+    std::array<float, 3> binScales{};
+    for (int axis = 0; axis < 3; ++axis) {
+        const float extent = centroids.max[axis] - centroids.min[axis];
+        binScales[axis] = extent > 0 ? binCount / extent : 0.0f;
+    }
+    const auto binOf = [&](const glm::vec4 &sphere, const int axis) {
+        return std::min(binCount - 1, (int)((sphere[axis] - centroids.min[axis]) * binScales[axis]));
+    };
+
+    // All three axes in one pass over the items.
+    using AxisBins = std::array<std::array<Bin, binCount>, 3>;
+    const auto bins = Reduce<AxisBins>(
+        jobSystem, node.count,
+        [&](AxisBins &bins, const size_t begin, const size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                const glm::vec4 &sphere = spheres[i];
+                const Bin item{.boundsMin = glm::vec3(sphere) - glm::vec3(sphere.w), .boundsMax = glm::vec3(sphere) + glm::vec3(sphere.w), .count = 1};
+                for (int axis = 0; axis < 3; ++axis) {
+                    Grow(bins[axis][binOf(sphere, axis)], item);
+                }
+            }
+        },
+        [](AxisBins &bins, const AxisBins &other) {
+            for (int axis = 0; axis < 3; ++axis) {
+                for (int bin = 0; bin < binCount; ++bin) {
+                    Grow(bins[axis][bin], other[axis][bin]);
+                }
+            }
+        });
+
+    // Cheapest of the binCount - 1 planes between the bins on each axis, cost is area times item count per side.
+    // The bounds of the winning sides are the children's bounds, so they need no pass of their own.
+    float bestCost = INFINITY;
+    int bestAxis = -1;
+    int bestSplit = 0;
+    Bin bestLeft;
+    Bin bestRight;
+    for (int axis = 0; axis < 3; ++axis) {
+        if (binScales[axis] == 0.0f) {
+            continue;
+        }
+
+        std::array<Bin, binCount - 1> lefts{};
+        Bin left;
+        for (int split = 0; split < binCount - 1; ++split) {
+            Grow(left, bins[axis][split]);
+            lefts[split] = left;
+        }
+
+        Bin right;
+        for (int split = binCount - 2; split >= 0; --split) {
+            Grow(right, bins[axis][split + 1]);
+            if (lefts[split].count == 0 || right.count == 0) {
+                continue;
+            }
+            const float cost = (float)lefts[split].count * SurfaceArea(lefts[split].boundsMin, lefts[split].boundsMax) + (float)right.count * SurfaceArea(right.boundsMin, right.boundsMax);
+            if (cost < bestCost) {
+                bestCost = cost;
+                bestAxis = axis;
+                bestSplit = split;
+                bestLeft = lefts[split];
+                bestRight = right;
+            }
+        }
+    }
+
+    // Every centroid in the same place, nothing separates them.
+    if (bestAxis < 0) {
+        return false;
+    }
+
+    // Partitions the items and their spheres together.
+    uint32_t left = node.leftOrFirst;
+    uint32_t right = node.leftOrFirst + node.count;
+    while (left < right) {
+        if (binOf(this->buildSpheres[left], bestAxis) <= bestSplit) {
+            ++left;
+        } else {
+            --right;
+            std::swap(this->buildSpheres[left], this->buildSpheres[right]);
+            std::swap(this->itemOrder[left], this->itemOrder[right]);
+        }
+    }
+
+    const auto leftIndex = (uint32_t)nodes.size();
+    nodes.push_back(BvhNode{.boundsMin = bestLeft.boundsMin, .leftOrFirst = node.leftOrFirst, .boundsMax = bestLeft.boundsMax, .count = bestLeft.count});
+    nodes.push_back(BvhNode{.boundsMin = bestRight.boundsMin, .leftOrFirst = node.leftOrFirst + bestLeft.count, .boundsMax = bestRight.boundsMax, .count = bestRight.count});
+
+    nodes[nodeIndex].leftOrFirst = leftIndex;
+    nodes[nodeIndex].count = 0;
+    return true;
+}
+
+void Bvh::Refit(std::span<const glm::vec4> spheres) {
+    ProfileScope profileScope("Bvh::Refit");
+
+    if (spheres.size() != this->spheres.size()) {
+        this->Build(spheres);
+        return;
+    }
+    this->spheres.assign(spheres.begin(), spheres.end());
+
+    // Children are always created after their parent, so walking backwards visits them first.
+    for (size_t i = this->nodes.size(); i-- > 0;) {
+        BvhNode &node = this->nodes[i];
+        if (node.count > 0) {
+            this->UpdateLeafBounds(node);
+            continue;
+        }
+        const BvhNode &left = this->nodes[node.leftOrFirst];
+        const BvhNode &right = this->nodes[node.leftOrFirst + 1];
+        node.boundsMin = Min(left.boundsMin, right.boundsMin);
+        node.boundsMax = Max(left.boundsMax, right.boundsMax);
+    }
+}
+
+void Bvh::Clear() {
+    this->nodes.clear();
+    this->itemOrder.clear();
+    this->spheres.clear();
+    this->buildSpheres.clear();
+}
+
+void Bvh::SetJobSystem(JobSystem *jobSystem) {
+    this->jobSystem = jobSystem;
+}
+
+void Bvh::AppendSubtree(const uint32_t nodeIndex, std::vector<uint32_t> &items) const {
+    std::vector<uint32_t> stack{nodeIndex};
+    while (!stack.empty()) {
+        const BvhNode &node = this->nodes[stack.back()];
+        stack.pop_back();
+        if (node.count > 0) {
+            items.insert(items.end(), this->itemOrder.begin() + node.leftOrFirst, this->itemOrder.begin() + node.leftOrFirst + node.count);
+        } else {
+            stack.push_back(node.leftOrFirst);
+            stack.push_back(node.leftOrFirst + 1);
+        }
+    }
+}
+
+void Bvh::QueryFrustum(const Frustum &frustum, std::vector<uint32_t> &items) const {
+    if (this->nodes.empty()) {
+        return;
+    }
+
+    std::vector<uint32_t> stack{0};
+    while (!stack.empty()) {
+        const uint32_t nodeIndex = stack.back();
+        const BvhNode &node = this->nodes[nodeIndex];
+        stack.pop_back();
+
+        const Containment containment = ClassifyBox(frustum, node.boundsMin, node.boundsMax);
+        if (containment == Containment::Outside) {
+            continue;
+        }
+        if (containment == Containment::Inside) {
+            this->AppendSubtree(nodeIndex, items);  // No further tests below here
+            continue;
+        }
+
+        if (node.count > 0) {
+            for (uint32_t i = node.leftOrFirst; i < node.leftOrFirst + node.count; ++i) {
+                const glm::vec4 &sphere = this->spheres[this->itemOrder[i]];
+                if (IsSphereInFrustum(frustum, glm::vec3(sphere), sphere.w)) {
+                    items.push_back(this->itemOrder[i]);
+                }
+            }
+        } else {
+            stack.push_back(node.leftOrFirst);
+            stack.push_back(node.leftOrFirst + 1);
+        }
+    }
+}
+
+auto Bvh::Raycast(const glm::vec3 origin, const glm::vec3 direction, const float maxDistance) const -> BvhHit {
+    BvhHit hit;
+    hit.distance = maxDistance;
+    if (this->nodes.empty()) {
+        return BvhHit{};
+    }
+
+    const glm::vec3 inverseDirection = 1.0f / direction;
+    const float rootDistance = IntersectBox(origin, inverseDirection, this->nodes[0].boundsMin, this->nodes[0].boundsMax, hit.distance);
+    std::vector<StackEntry> stack{{0, rootDistance}};
+    while (!stack.empty()) {
+        const StackEntry entry = stack.back();
+        stack.pop_back();
+        if (entry.distance > hit.distance) {
+            continue;
+        }
+
+        const BvhNode &node = this->nodes[entry.node];
+        if (node.count > 0) {
+            for (uint32_t i = node.leftOrFirst; i < node.leftOrFirst + node.count; ++i) {
+                const glm::vec4 &sphere = this->spheres[this->itemOrder[i]];
+                const float distance = IntersectBox(origin, inverseDirection, glm::vec3(sphere) - glm::vec3(sphere.w), glm::vec3(sphere) + glm::vec3(sphere.w), hit.distance);
+                if (distance < hit.distance || (distance == hit.distance && hit.item == BvhHit::noItem)) {
+                    hit = BvhHit{.item = this->itemOrder[i], .distance = distance};
+                }
+            }
+            continue;
+        }
+
+        // Nearer child on top so it is visited first and tightens the bound for the other.
+        StackEntry left{node.leftOrFirst, IntersectBox(origin, inverseDirection, this->nodes[node.leftOrFirst].boundsMin, this->nodes[node.leftOrFirst].boundsMax, hit.distance)};
+        StackEntry right{node.leftOrFirst + 1, IntersectBox(origin, inverseDirection, this->nodes[node.leftOrFirst + 1].boundsMin, this->nodes[node.leftOrFirst + 1].boundsMax, hit.distance)};
+        if (left.distance < right.distance) {
+            std::swap(left, right);
+        }
+        for (const StackEntry &child : {left, right}) {
+            if (child.distance != INFINITY) {
+                stack.push_back(child);
+            }
+        }
+    }
+
+    return hit.item == BvhHit::noItem ? BvhHit{} : hit;
+}
+
+auto Bvh::FindNearest(const glm::vec3 point, const float maxDistance) const -> BvhHit {
+    if (this->nodes.empty()) {
+        return BvhHit{};
+    }
+
+    // Squared until the end. A center lies inside its item's box, so the distance to a node's box bounds its items.
+    BvhHit nearest;
+    nearest.distance = maxDistance * maxDistance;
+    std::vector<StackEntry> stack{{0, DistanceSquaredToBox(point, this->nodes[0].boundsMin, this->nodes[0].boundsMax)}};
+    while (!stack.empty()) {
+        const StackEntry entry = stack.back();
+        stack.pop_back();
+        if (entry.distance > nearest.distance) {
+            continue;
+        }
+
+        const BvhNode &node = this->nodes[entry.node];
+        if (node.count > 0) {
+            for (uint32_t i = node.leftOrFirst; i < node.leftOrFirst + node.count; ++i) {
+                const glm::vec3 offset = glm::vec3(this->spheres[this->itemOrder[i]]) - point;
+                const float distance = glm::dot(offset, offset);
+                if (distance <= nearest.distance && (distance < nearest.distance || nearest.item == BvhHit::noItem)) {
+                    nearest = BvhHit{.item = this->itemOrder[i], .distance = distance};
+                }
+            }
+            continue;
+        }
+
+        StackEntry left{node.leftOrFirst, DistanceSquaredToBox(point, this->nodes[node.leftOrFirst].boundsMin, this->nodes[node.leftOrFirst].boundsMax)};
+        StackEntry right{node.leftOrFirst + 1, DistanceSquaredToBox(point, this->nodes[node.leftOrFirst + 1].boundsMin, this->nodes[node.leftOrFirst + 1].boundsMax)};
+        if (left.distance < right.distance) {
+            std::swap(left, right);
+        }
+        stack.push_back(left);
+        stack.push_back(right);
+    }
+
+    if (nearest.item == BvhHit::noItem) {
+        return BvhHit{};
+    }
+    nearest.distance = std::sqrt(nearest.distance);
+    return nearest;
+}
+
+auto Bvh::Size() const -> size_t {
+    return this->spheres.size();
+}
+
+auto Bvh::GetNodeCount() const -> size_t {
+    return this->nodes.size();
+}
+
+auto Bvh::GetSphere(const uint32_t item) const -> glm::vec4 {
+    return this->spheres[item];
+}
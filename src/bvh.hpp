@@ -0,0 +1,78 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <vector>
+#include "frustum.hpp"
+#include "jobSystem.hpp"
+
+// 32 bytes so two siblings share a cache line.
+struct BvhNode {
+    glm::vec3 boundsMin{0.0f};
+    uint32_t leftOrFirst = 0;  // First of the two adjacent children when count is 0, else first slot in the item order
+    glm::vec3 boundsMax{0.0f};
+    uint32_t count = 0;  // Items in a leaf, 0 for inner nodes
+};
+static_assert(sizeof(BvhNode) == 32);
+
+struct BvhHit {
+    static constexpr uint32_t noItem = std::numeric_limits<uint32_t>::max();
+
+    uint32_t item = noItem;
+    float distance = INFINITY;
+};
+
+// Bounding volume hierarchy over bounding spheres, items are identified by their index in the span given to Build.
+// Built top-down with a binned surface area heuristic, then refit in place while the items only move,
+// so mostly-static scenes pay for the build once. With a job system the top levels bin in parallel
+// and the subtrees below them build as separate jobs.
+class Bvh {
+   public:
+    Bvh() = default;
+    ~Bvh() = default;
+    Bvh(const Bvh &) = delete;
+    Bvh(Bvh &&) = delete;
+    auto operator=(const Bvh &) -> Bvh & = delete;
+    auto operator=(Bvh &&) -> Bvh & = delete;
+
+    // xyz center, w radius.
+    void Build(std::span<const glm::vec4> spheres);
+    // Same items with new bounds, keeps the tree topology. Quality degrades as items drift from where they were built.
+    void Refit(std::span<const glm::vec4> spheres);
+    void Clear();
+    // Not owned, nullptr builds on the calling thread.
+    void SetJobSystem(JobSystem *jobSystem);
+
+    // Appends the items whose sphere is at least partly inside the frustum.
+    void QueryFrustum(const Frustum &frustum, std::vector<uint32_t> &items) const;
+    // Closest item whose bounding box the ray enters within maxDistance, direction does not need to be normalized
+    // but distance is in units of its length.
+    auto Raycast(const glm::vec3 origin, const glm::vec3 direction, const float maxDistance = INFINITY) const -> BvhHit;
+    // Item with the closest center within maxDistance.
+    auto FindNearest(const glm::vec3 point, const float maxDistance = INFINITY) const -> BvhHit;
+
+    auto Size() const -> size_t;
+    auto GetNodeCount() const -> size_t;
+    auto GetSphere(const uint32_t item) const -> glm::vec4;
+
+   private:
+    static constexpr uint32_t maxLeafSize = 4;
+    // Subtrees at most this large are built by a single job.
+    static constexpr uint32_t minParallelSubtreeSize = 4096;
+
+    std::vector<BvhNode> nodes;
+    std::vector<uint32_t> itemOrder;  // Leaves reference ranges of this
+    std::vector<glm::vec4> spheres;
+    std::vector<glm::vec4> buildSpheres;  // spheres in item order, reordered with it so the build reads them sequentially
+    JobSystem *jobSystem = nullptr;
+
+    void UpdateLeafBounds(BvhNode &node) const;
+    // Splits the leaf nodes[nodeIndex] and appends its children to nodes, returns false when it stays a leaf.
+    // Bins on jobSystem when given, which must then not be running a job already.
+    auto Subdivide(std::vector<BvhNode> &nodes, const uint32_t nodeIndex, JobSystem *jobSystem) -> bool;
+    // Subdivides everything below nodes[rootIndex] on the calling thread.
+    void BuildSubtree(std::vector<BvhNode> &nodes, const uint32_t rootIndex);
+    void AppendSubtree(const uint32_t nodeIndex, std::vector<uint32_t> &items) const;
+};
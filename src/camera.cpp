@@ -1,7 +1,25 @@
 #include "camera.hpp"
+#include <cmath>
 #include "glm/ext/matrix_clip_space.hpp"
 #include "glm/ext/matrix_transform.hpp"
 
+auto GetScreenScale(const glm::mat4x4 &projectionMatrix, const float viewportHeight) -> float {
+    return projectionMatrix[1][1] * viewportHeight * 0.5f;
+}
+
+auto GetPointerRay(const glm::mat4x4 &viewMatrix, const glm::mat4x4 &projectionMatrix, const glm::vec2 pointer, const glm::vec2 viewportSize) -> Ray {
+    const float ndcX = 2.0f * pointer.x / viewportSize.x - 1.0f;
+    const float ndcY = 1.0f - 2.0f * pointer.y / viewportSize.y;
+
+    // The view-space point at depth 1 that projects onto the pointer, the off-center terms cancel the shift of asymmetric frusta.
+    const glm::vec3 viewDirection((ndcX + projectionMatrix[2][0]) / projectionMatrix[0][0], (ndcY + projectionMatrix[2][1]) / projectionMatrix[1][1], -1.0f);
+    const glm::mat4x4 inverseView = glm::inverse(viewMatrix);
+    return Ray{
+        .origin = glm::vec3(inverseView[3]),
+        .direction = glm::normalize(glm::vec3(inverseView * glm::vec4(viewDirection, 0.0f))),
+    };
+}
+
 void Camera::SetPosition(const glm::vec3 position) {
     this->position = position;
 }
@@ -12,7 +30,29 @@ void Camera::Init(uint32_t width, uint32_t height, glm::vec3 position) {
 }
 
 void Camera::Resize(uint32_t width, uint32_t height) {
-    this->projectionMatrix = glm::perspective(glm::radians(75.0f), float(width) / float(height), 0.1f, 1000.0f);
+    this->aspectRatio = float(width) / float(height);
+    this->UpdateProjectionMatrix();
+}
+
+void Camera::SetReverseZ(const bool enabled) {
+    this->reverseZ = enabled;
+    this->UpdateProjectionMatrix();
+}
+
+void Camera::UpdateProjectionMatrix() {
+    if (!this->reverseZ) {
+        this->projectionMatrix = glm::perspective(this->fieldOfView, this->aspectRatio, this->nearPlane, this->farPlane);
+        return;
+    }
+
+    // Limit of the 0..1 depth perspective with near and far swapped as far goes to infinity:
+    // clip z is the constant near distance and w the view depth, so depth = near / distance.
+    const float focalLength = 1.0f / std::tan(this->fieldOfView * 0.5f);
+    this->projectionMatrix = glm::mat4x4(0.0f);
+    this->projectionMatrix[0][0] = focalLength / this->aspectRatio;
+    this->projectionMatrix[1][1] = focalLength;
+    this->projectionMatrix[2][3] = -1.0f;
+    this->projectionMatrix[3][2] = this->nearPlane;
 }
 
 void Camera::ProcessMouseMovement(const int mouseDeltaX, const int mouseDeltaY) {
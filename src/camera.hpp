@@ -2,6 +2,18 @@
 #include <glm/glm.hpp>
 #include "glm/fwd.hpp"
 
+// Pixels covered by one world unit at view depth 1, divide by depth for the size of anything further away.
+auto GetScreenScale(const glm::mat4x4 &projectionMatrix, const float viewportHeight) -> float;
+
+struct Ray {
+    glm::vec3 origin;
+    glm::vec3 direction;  // Normalized
+};
+
+// World-space ray from the eye through a pixel, pointer is in pixels from the top left of the viewport.
+// Only reads the perspective terms of projectionMatrix, so it holds for reverse-Z and an infinite far plane.
+auto GetPointerRay(const glm::mat4x4 &viewMatrix, const glm::mat4x4 &projectionMatrix, const glm::vec2 pointer, const glm::vec2 viewportSize) -> Ray;
+
 class Camera {
    public:
     Camera() = default;
@@ -13,6 +25,9 @@ class Camera {
 
     void Init(uint32_t width, uint32_t height, glm::vec3 position);
     void Resize(uint32_t width, uint32_t height);
+    // Infinite far plane with depth 1 at the near plane falling towards 0, for a Depth32Float buffer cleared to 0
+    // and tested with Greater. Float precision then spreads evenly over distance instead of piling up at the near plane.
+    void SetReverseZ(const bool enabled);
     void SetPosition(const glm::vec3 position);
     void ProcessMouseMovement(const int mouseDeltaX, const int mouseDeltaY);
     auto GetViewMatrix() -> glm::mat4x4;
@@ -24,8 +39,16 @@ class Camera {
 
     float sensitivity = 0.3f;
 
+    float fieldOfView = glm::radians(75.0f);
+    float aspectRatio = 1.0f;
+    float nearPlane = 0.1f;
+    float farPlane = 1000.0f;  // Ignored with reverse-Z
+    bool reverseZ = false;
+
     glm::mat4x4 projectionMatrix = glm::mat4x4(1);
     glm::vec3 position = glm::vec3(0.0f, 0.0f, 0.0f);
     glm::vec3 cameraFront = glm::vec3(0.0f, 0.0f, -1.0f);
     glm::vec3 cameraUp = glm::vec3(0.0f, 1.0f, 0.0f);
+
+    void UpdateProjectionMatrix();
 };
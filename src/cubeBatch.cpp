@@ -0,0 +1,258 @@
+#include "cubeBatch.hpp"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include "frustum.hpp"
+#include "profiler.hpp"
+
+namespace {
+template <typename T>
+void EraseInvisible(std::vector<T> &instances, const std::vector<uint8_t> &visible) {
+    size_t kept = 0;
+    for (size_t i = 0; i < instances.size(); ++i) {
+        if (visible[i] != 0) {
+            instances[kept++] = instances[i];
+        }
+    }
+    instances.resize(kept);
+}
+
+template <typename T>
+void Reorder(std::vector<T> &instances, std::vector<T> &scratch, const std::vector<uint32_t> &order) {
+    scratch.resize(instances.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        scratch[i] = instances[order[i]];
+    }
+    instances.swap(scratch);
+}
+}  // namespace
+
+CubeBatch::CubeBatch(const CubeInstanceFormat format, const size_t initialCapacity) : format(format) {
+    if (format == CubeInstanceFormat::Compact) {
+        this->compactInstances.reserve(initialCapacity);
+    } else {
+        this->modelMatrices.reserve(initialCapacity);
+    }
+}
+
+void CubeBatch::Add(const glm::mat4x4 &transform) {
+    if (this->format == CubeInstanceFormat::Compact) {
+        this->compactInstances.push_back(PackCompactCubeInstance(transform));
+    } else {
+        this->modelMatrices.push_back(transform);
+    }
+}
+
+void CubeBatch::Add(const glm::vec3 translation, const glm::quat rotation, const float scale) {
+    if (this->format == CubeInstanceFormat::Compact) {
+        this->compactInstances.push_back(PackCompactCubeInstance(translation, rotation, scale));
+    } else {
+        glm::mat4x4 transform = glm::mat4x4(glm::mat3_cast(rotation) * scale);
+        transform[3] = glm::vec4(translation, 1.0f);
+        this->modelMatrices.push_back(transform);
+    }
+}
+
+void CubeBatch::ForEachChunk(const size_t count, const JobSystem::Job &job) {
+    if (this->jobSystem != nullptr) {
+        this->jobSystem->ParallelFor(count, CubeBatch::jobChunkSize, job);
+    } else {
+        job(0, count);
+    }
+}
+
+void CubeBatch::Add(std::span<const glm::vec3> translations, std::span<const float> scales, const glm::quat rotation) {
+    const size_t count = translations.size();
+
+    if (this->format == CubeInstanceFormat::Compact) {
+        const size_t start = this->compactInstances.size();
+        this->compactInstances.resize(start + count);
+        const std::span<CompactCubeInstance> out = std::span(this->compactInstances).subspan(start);
+        this->ForEachChunk(count, [&](size_t begin, size_t end) {
+            PackCompactCubeInstances(translations.subspan(begin, end - begin), scales.subspan(begin, end - begin), rotation, out.subspan(begin, end - begin));
+        });
+    } else {
+        const size_t start = this->modelMatrices.size();
+        this->modelMatrices.resize(start + count);
+        const std::span<glm::mat4x4> out = std::span(this->modelMatrices).subspan(start);
+        this->ForEachChunk(count, [&](size_t begin, size_t end) {
+            BuildInstanceMatrices(translations.subspan(begin, end - begin), scales.subspan(begin, end - begin), rotation, out.subspan(begin, end - begin));
+        });
+    }
+}
+
+auto CubeBatch::GetInstanceSphere(const size_t index) const -> glm::vec4 {
+    if (this->format == CubeInstanceFormat::Compact) {
+        const CompactCubeInstance &instance = this->compactInstances[index];
+        return glm::vec4(instance.translation, std::abs(instance.scale));
+    }
+
+    const glm::mat4x4 &transform = this->modelMatrices[index];
+    const float scale = std::max({glm::length(glm::vec3(transform[0])), glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2]))});
+    return glm::vec4(glm::vec3(transform[3]), scale);
+}
+
+void CubeBatch::Cull(const glm::mat4x4 &viewProjectionMatrix, const float boundingRadius) {
+    ProfileScope profileScope("CubeBatch::Cull");
+
+    const bool isCompact = this->format == CubeInstanceFormat::Compact;
+    const size_t count = this->Size();
+
+    this->cullCenterX.resize(count);
+    this->cullCenterY.resize(count);
+    this->cullCenterZ.resize(count);
+    this->cullRadius.resize(count);
+    this->cullVisible.resize(count);
+
+    const Frustum frustum = ExtractFrustum(viewProjectionMatrix);
+    this->ForEachChunk(count, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            const glm::vec4 sphere = this->GetInstanceSphere(i);
+            this->cullCenterX[i] = sphere.x;
+            this->cullCenterY[i] = sphere.y;
+            this->cullCenterZ[i] = sphere.z;
+            this->cullRadius[i] = sphere.w * boundingRadius;
+        }
+
+        CullSpheres(frustum, this->cullCenterX.data() + begin, this->cullCenterY.data() + begin, this->cullCenterZ.data() + begin, this->cullRadius.data() + begin, end - begin, this->cullVisible.data() + begin);
+    });
+
+    // Compaction stays serial, it is a single pass of copies.
+
+    if (isCompact) {
+        EraseInvisible(this->compactInstances, this->cullVisible);
+    } else {
+        EraseInvisible(this->modelMatrices, this->cullVisible);
+    }
+}
+
+void CubeBatch::SortFrontToBack(const glm::mat4x4 &viewProjectionMatrix) {
+    ProfileScope profileScope("CubeBatch::SortFrontToBack");
+
+    const bool isCompact = this->format == CubeInstanceFormat::Compact;
+    const size_t count = this->Size();
+    if (count < 2) {
+        return;
+    }
+
+    // Clip w of a perspective projection is the distance along the view direction.
+    const glm::vec4 depthRow(viewProjectionMatrix[0][3], viewProjectionMatrix[1][3], viewProjectionMatrix[2][3], viewProjectionMatrix[3][3]);
+
+    this->sortDepths.resize(count);
+    float minDepth = INFINITY;
+    float maxDepth = -INFINITY;
+    for (size_t i = 0; i < count; ++i) {
+        const float depth = glm::dot(glm::vec3(depthRow), glm::vec3(this->GetInstanceSphere(i))) + depthRow.w;
+        this->sortDepths[i] = depth;
+        minDepth = std::min(minDepth, depth);
+        maxDepth = std::max(maxDepth, depth);
+    }
+
+    const float keyScale = maxDepth > minDepth ? 65535.0f / (maxDepth - minDepth) : 0.0f;
+    this->sortKeys.resize(count);
+    this->sortOrder.resize(count);
+    this->sortScratchOrder.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        this->sortKeys[i] = static_cast<uint16_t>((this->sortDepths[i] - minDepth) * keyScale);
+        this->sortOrder[i] = static_cast<uint32_t>(i);
+    }
+
+    // Least significant byte first, each pass is stable so the second keeps the first's order within a bucket.
+    for (const int shift : {0, 8}) {
+        std::array<uint32_t, 257> offsets{};
+        for (const uint16_t key : this->sortKeys) {
+            offsets[((key >> shift) & 0xFF) + 1]++;
+        }
+        for (size_t bucket = 1; bucket < offsets.size(); ++bucket) {
+            offsets[bucket] += offsets[bucket - 1];
+        }
+        for (const uint32_t index : this->sortOrder) {
+            this->sortScratchOrder[offsets[(this->sortKeys[index] >> shift) & 0xFF]++] = index;
+        }
+        this->sortOrder.swap(this->sortScratchOrder);
+    }
+
+    if (isCompact) {
+        Reorder(this->compactInstances, this->sortedCompactInstances, this->sortOrder);
+    } else {
+        Reorder(this->modelMatrices, this->sortedModelMatrices, this->sortOrder);
+    }
+}
+
+void CubeBatch::SplitByScreenSize(const glm::mat4x4 &viewProjectionMatrix, const float screenScale, const float boundingRadius, std::span<const float> maxScreenSizes, std::span<CubeBatch *const> levels) {
+    ProfileScope profileScope("CubeBatch::SplitByScreenSize");
+
+    const bool isCompact = this->format == CubeInstanceFormat::Compact;
+    const size_t count = this->Size();
+    const size_t levelCount = std::min(maxScreenSizes.size(), levels.size());
+
+    // Clip w of a perspective projection is the distance along the view direction.
+    const glm::vec4 depthRow(viewProjectionMatrix[0][3], viewProjectionMatrix[1][3], viewProjectionMatrix[2][3], viewProjectionMatrix[3][3]);
+    const float diameterScale = 2.0f * boundingRadius * screenScale;
+
+    size_t kept = 0;
+    for (size_t i = 0; i < count; ++i) {
+        const glm::vec4 sphere = this->GetInstanceSphere(i);
+        const float depth = std::max(glm::dot(glm::vec3(depthRow), glm::vec3(sphere)) + depthRow.w, 1e-6f);
+        const float screenSize = diameterScale * sphere.w / depth;
+
+        size_t level = 0;
+        while (level < levelCount && screenSize < maxScreenSizes[level]) {
+            ++level;
+        }
+
+        if (level == 0) {
+            if (isCompact) {
+                this->compactInstances[kept++] = this->compactInstances[i];
+            } else {
+                this->modelMatrices[kept++] = this->modelMatrices[i];
+            }
+        } else if (isCompact) {
+            levels[level - 1]->compactInstances.push_back(this->compactInstances[i]);
+        } else {
+            levels[level - 1]->modelMatrices.push_back(this->modelMatrices[i]);
+        }
+    }
+
+    if (isCompact) {
+        this->compactInstances.resize(kept);
+    } else {
+        this->modelMatrices.resize(kept);
+    }
+}
+
+void CubeBatch::Clear() {
+    this->modelMatrices.clear();
+    this->compactInstances.clear();
+}
+
+void CubeBatch::SetJobSystem(JobSystem *jobSystem) {
+    this->jobSystem = jobSystem;
+}
+
+auto CubeBatch::GetFormat() const -> CubeInstanceFormat {
+    return this->format;
+}
+
+auto CubeBatch::Size() const -> size_t {
+    return this->format == CubeInstanceFormat::Compact ? this->compactInstances.size() : this->modelMatrices.size();
+}
+
+auto CubeBatch::Empty() const -> bool {
+    return this->Size() == 0;
+}
+
+auto CubeBatch::GetModelMatrices() const -> const std::vector<glm::mat4x4> & {
+    return this->modelMatrices;
+}
+
+auto CubeBatch::GetCompactInstances() const -> const std::vector<CompactCubeInstance> & {
+    return this->compactInstances;
+}
+
+auto CubeBatch::GetInstanceBytes() const -> std::span<const std::byte> {
+    if (this->format == CubeInstanceFormat::Compact) {
+        return std::as_bytes(std::span(this->compactInstances));
+    }
+    return std::as_bytes(std::span(this->modelMatrices));
+}
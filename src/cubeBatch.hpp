@@ -0,0 +1,72 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+#include "instancePacking.hpp"
+#include "jobSystem.hpp"
+
+// Cubes drawn this frame, stored in the CubeShader's instance format so they can be uploaded as-is.
+class CubeBatch {
+   public:
+    CubeBatch(const CubeInstanceFormat format, const size_t initialCapacity);
+    ~CubeBatch() = default;
+    CubeBatch(const CubeBatch &) = delete;
+    CubeBatch(CubeBatch &&) = delete;
+    auto operator=(const CubeBatch &) -> CubeBatch & = delete;
+    auto operator=(CubeBatch &&) -> CubeBatch & = delete;
+
+    void Add(const glm::mat4x4 &transform);
+    void Add(const glm::vec3 translation, const glm::quat rotation, const float scale);
+    // Split across the job system's workers in chunks when one is set.
+    void Add(std::span<const glm::vec3> translations, std::span<const float> scales, const glm::quat rotation);
+    // Drops instances whose bounding sphere is fully outside the frustum, boundingRadius is at scale 1.
+    void Cull(const glm::mat4x4 &viewProjectionMatrix, const float boundingRadius = cubeBoundingRadius);
+    // Orders instances nearest first by view depth so early-Z rejects more of the ones behind.
+    // Coarse, depths are quantized to 16 bits over the batch's range and radix sorted in two passes.
+    void SortFrontToBack(const glm::mat4x4 &viewProjectionMatrix);
+    // Moves instances whose projected bounding diameter, in pixels, is below maxScreenSizes[i] into levels[i],
+    // the last matching level wins. maxScreenSizes has to be decreasing and levels in this batch's format.
+    // screenScale is from GetScreenScale, boundingRadius is at scale 1.
+    void SplitByScreenSize(const glm::mat4x4 &viewProjectionMatrix, const float screenScale, const float boundingRadius, std::span<const float> maxScreenSizes, std::span<CubeBatch *const> levels);
+    void Clear();
+    // Not owned, nullptr runs everything on the calling thread.
+    void SetJobSystem(JobSystem *jobSystem);
+
+    auto GetFormat() const -> CubeInstanceFormat;
+    auto Size() const -> size_t;
+    auto Empty() const -> bool;
+    auto GetModelMatrices() const -> const std::vector<glm::mat4x4> &;
+    auto GetCompactInstances() const -> const std::vector<CompactCubeInstance> &;
+    // Whichever of the two above matches the format.
+    auto GetInstanceBytes() const -> std::span<const std::byte>;
+
+   private:
+    static constexpr size_t jobChunkSize = 4096;
+
+    CubeInstanceFormat format;
+    JobSystem *jobSystem = nullptr;
+    std::vector<glm::mat4x4> modelMatrices;
+    std::vector<CompactCubeInstance> compactInstances;
+
+    // Bounding spheres as structure-of-arrays for CullSpheres, kept to avoid reallocating every frame.
+    std::vector<float> cullCenterX;
+    std::vector<float> cullCenterY;
+    std::vector<float> cullCenterZ;
+    std::vector<float> cullRadius;
+    std::vector<uint8_t> cullVisible;
+
+    // Radix sort state and the reordered copies, swapped in when the sort is done.
+    std::vector<float> sortDepths;
+    std::vector<uint16_t> sortKeys;
+    std::vector<uint32_t> sortOrder;
+    std::vector<uint32_t> sortScratchOrder;
+    std::vector<glm::mat4x4> sortedModelMatrices;
+    std::vector<CompactCubeInstance> sortedCompactInstances;
+
+    void ForEachChunk(const size_t count, const JobSystem::Job &job);
+    // xyz center and w the largest axis scale.
+    auto GetInstanceSphere(const size_t index) const -> glm::vec4;
+};
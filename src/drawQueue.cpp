@@ -0,0 +1,58 @@
+#include "drawQueue.hpp"
+#include <algorithm>
+#include <cstring>
+
+DrawQueue::DrawQueue(const size_t instanceStride) : instanceStride(instanceStride) {
+}
+
+void DrawQueue::Submit(const uint32_t pipeline, const uint32_t mesh, std::span<const std::byte> instances) {
+    if (instances.empty()) {
+        return;
+    }
+
+    this->submissions.push_back(Submission{
+        .key = (uint64_t)pipeline << 32 | mesh,
+        .instances = instances,
+    });
+    this->instanceBytes += instances.size();
+}
+
+auto DrawQueue::GetInstanceStride() const -> size_t {
+    return this->instanceStride;
+}
+
+auto DrawQueue::GetInstanceBytes() const -> size_t {
+    return this->instanceBytes;
+}
+
+auto DrawQueue::Build(std::byte *destination) -> const std::vector<DrawCommand> & {
+    // Stable, so instances keep their submission order within a draw.
+    std::stable_sort(this->submissions.begin(), this->submissions.end(), [](const Submission &a, const Submission &b) {
+        return a.key < b.key;
+    });
+
+    this->commands.clear();
+    size_t offset = 0;
+    for (const auto &submission : this->submissions) {
+        const auto instanceCount = (uint32_t)(submission.instances.size() / this->instanceStride);
+        if (this->commands.empty() || ((uint64_t)this->commands.back().pipeline << 32 | this->commands.back().mesh) != submission.key) {
+            this->commands.push_back(DrawCommand{
+                .pipeline = (uint32_t)(submission.key >> 32),
+                .mesh = (uint32_t)submission.key,
+                .firstInstance = (uint32_t)(offset / this->instanceStride),
+                .instanceCount = 0,
+            });
+        }
+        this->commands.back().instanceCount += instanceCount;
+
+        std::memcpy(destination + offset, submission.instances.data(), submission.instances.size());
+        offset += submission.instances.size();
+    }
+
+    return this->commands;
+}
+
+void DrawQueue::Clear() {
+    this->submissions.clear();
+    this->instanceBytes = 0;
+}
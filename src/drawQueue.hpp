@@ -0,0 +1,44 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// One instanced draw over a contiguous range of the frame's instance buffer.
+struct DrawCommand {
+    uint32_t pipeline;
+    uint32_t mesh;
+    uint32_t firstInstance;
+    uint32_t instanceCount;
+};
+
+// Instanced draws submitted in any order, built into as few draws as possible sorted by pipeline then mesh,
+// so the render pass only changes state when it has to.
+class DrawQueue {
+   public:
+    explicit DrawQueue(const size_t instanceStride);
+    ~DrawQueue() = default;
+    DrawQueue(const DrawQueue &) = delete;
+    DrawQueue(DrawQueue &&) = delete;
+    auto operator=(const DrawQueue &) -> DrawQueue & = delete;
+    auto operator=(DrawQueue &&) -> DrawQueue & = delete;
+
+    // Not copied, instances has to stay valid until Build.
+    void Submit(const uint32_t pipeline, const uint32_t mesh, std::span<const std::byte> instances);
+    auto GetInstanceStride() const -> size_t;
+    auto GetInstanceBytes() const -> size_t;
+    // Writes every instance to destination in draw order, submissions sharing a pipeline and mesh become one draw.
+    auto Build(std::byte *destination) -> const std::vector<DrawCommand> &;
+    void Clear();
+
+   private:
+    struct Submission {
+        uint64_t key;  // pipeline << 32 | mesh
+        std::span<const std::byte> instances;
+    };
+
+    size_t instanceStride;
+    size_t instanceBytes = 0;
+    std::vector<Submission> submissions;
+    std::vector<DrawCommand> commands;
+};
@@ -0,0 +1,70 @@
+#include "dynamicBuffer.hpp"
+#include <algorithm>
+#include <iostream>
+
+DynamicBuffer::DynamicBuffer(const char *label, const wgpu::BufferUsage usage, const uint64_t initialSize, const size_t bufferCount)
+    : label(label), usage(usage | wgpu::BufferUsage::CopyDst), initialSize(std::max<uint64_t>(initialSize, 4)), slots(std::max<size_t>(bufferCount, 1)) {
+}
+
+auto DynamicBuffer::Allocate(Slot &slot, const uint64_t size) -> bool {
+    // Grow geometrically so a steadily increasing instance count only reallocates a handful of times.
+    uint64_t capacity = std::max(slot.capacity, this->initialSize);
+    while (capacity < size) {
+        capacity *= 2;
+    }
+
+    wgpu::BufferDescriptor bufferDesc{
+        .label = this->label,
+        .usage = this->usage,
+        .size = (capacity + 3) & ~uint64_t(3),  // WriteBuffer sizes must be a multiple of 4
+        .mappedAtCreation = false,
+    };
+
+    slot.buffer = std::make_unique<wgpu::Buffer>(this->device.CreateBuffer(&bufferDesc));
+    if (slot.buffer == nullptr || !*slot.buffer) {
+        std::cerr << "Cannot allocate WebGPU Buffer " << this->label << " of " << capacity << " bytes" << std::endl;
+        slot.capacity = 0;
+        return false;
+    }
+
+    slot.capacity = bufferDesc.size;
+    return true;
+}
+
+auto DynamicBuffer::Init(const wgpu::Device &device) -> bool {
+    this->device = device;
+
+    return std::all_of(this->slots.begin(), this->slots.end(), [this](Slot &slot) {
+        return this->Allocate(slot, this->initialSize);
+    });
+}
+
+auto DynamicBuffer::Write(const wgpu::Queue &queue, const void *data, const uint64_t size) -> bool {
+    if (!this->Next(size)) {
+        return false;
+    }
+
+    if (size > 0) {
+        queue.WriteBuffer(this->slots[this->current].buffer->Get(), 0, data, size);
+    }
+
+    return true;
+}
+
+auto DynamicBuffer::Next(const uint64_t size) -> bool {
+    this->current = (this->current + 1) % this->slots.size();
+    return this->Reserve(size);
+}
+
+auto DynamicBuffer::Reserve(const uint64_t size) -> bool {
+    Slot &slot = this->slots[this->current];
+    return size <= slot.capacity || this->Allocate(slot, size);
+}
+
+auto DynamicBuffer::Get() const -> wgpu::Buffer {
+    return *this->slots[this->current].buffer;
+}
+
+auto DynamicBuffer::GetCapacity() const -> uint64_t {
+    return this->slots[this->current].capacity;
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include <webgpu/webgpu_cpp.h>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// A small ring of GPU buffers that grow geometrically on demand.
+// Each Write() moves to the next buffer, so it never targets the one the in-flight frame reads from.
+class DynamicBuffer {
+   public:
+    DynamicBuffer(const char *label, const wgpu::BufferUsage usage, const uint64_t initialSize, const size_t bufferCount = 3);
+    ~DynamicBuffer() = default;
+    DynamicBuffer(const DynamicBuffer &) = delete;
+    DynamicBuffer(DynamicBuffer &&) = delete;
+    auto operator=(const DynamicBuffer &) -> DynamicBuffer & = delete;
+    auto operator=(DynamicBuffer &&) -> DynamicBuffer & = delete;
+
+    auto Init(const wgpu::Device &device) -> bool;
+    auto Write(const wgpu::Queue &queue, const void *data, const uint64_t size) -> bool;
+    // Moves to the next buffer and grows it to size without writing, for data copied in on the GPU.
+    auto Next(const uint64_t size) -> bool;
+    // Grows the current buffer without writing, for buffers only written on the GPU.
+    auto Reserve(const uint64_t size) -> bool;
+    auto Get() const -> wgpu::Buffer;
+    auto GetCapacity() const -> uint64_t;
+
+   private:
+    struct Slot {
+        std::unique_ptr<wgpu::Buffer> buffer;
+        uint64_t capacity = 0;
+    };
+
+    const char *label;
+    wgpu::BufferUsage usage;
+    uint64_t initialSize;
+    wgpu::Device device;
+    std::vector<Slot> slots;
+    size_t current = 0;
+
+    auto Allocate(Slot &slot, const uint64_t size) -> bool;
+};
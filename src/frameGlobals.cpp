@@ -0,0 +1,78 @@
+#include "frameGlobals.hpp"
+#include <array>
+
+auto FrameGlobals::Init(const wgpu::Device &device) -> bool {
+    wgpu::BufferDescriptor bufferDesc{
+        .label = "frame",
+        .usage = wgpu::BufferUsage::CopyDst | wgpu::BufferUsage::Uniform,
+        .size = sizeof(FrameUniforms),
+        .mappedAtCreation = false,
+    };
+    this->uniformBuffer = std::make_unique<wgpu::Buffer>(device.CreateBuffer(&bufferDesc));
+    if (this->uniformBuffer == nullptr) {
+        return false;
+    }
+
+    std::array<wgpu::BindGroupLayoutEntry, 1> bindingLayoutEntries{
+        wgpu::BindGroupLayoutEntry{
+            .binding = 0,
+            .visibility = wgpu::ShaderStage::Vertex | wgpu::ShaderStage::Fragment,
+            .buffer = wgpu::BufferBindingLayout{
+                .type = wgpu::BufferBindingType::Uniform,
+                .minBindingSize = sizeof(FrameUniforms),
+            },
+        },
+    };
+
+    wgpu::BindGroupLayoutDescriptor bindGroupLayoutDesc{
+        .label = "frame",
+        .entryCount = (uint32_t)bindingLayoutEntries.size(),
+        .entries = bindingLayoutEntries.data(),
+    };
+    this->bindGroupLayout = std::make_unique<wgpu::BindGroupLayout>(device.CreateBindGroupLayout(&bindGroupLayoutDesc));
+    if (this->bindGroupLayout == nullptr) {
+        return false;
+    }
+
+    std::array<wgpu::BindGroupEntry, 1> bindings = {
+        wgpu::BindGroupEntry{
+            .binding = 0,
+            .buffer = this->uniformBuffer->Get(),
+            .offset = 0,
+            .size = sizeof(FrameUniforms),
+        },
+    };
+
+    wgpu::BindGroupDescriptor bindGroupDesc = {
+        .label = "frame bind group",
+        .layout = this->bindGroupLayout->Get(),
+        .entryCount = (uint32_t)bindings.size(),
+        .entries = bindings.data(),
+    };
+    this->bindGroup = std::make_unique<wgpu::BindGroup>(device.CreateBindGroup(&bindGroupDesc));
+
+    return this->bindGroup != nullptr;
+}
+
+void FrameGlobals::Update(UploadRing &uploadRing, const glm::mat4x4 &cameraViewMatrix, const glm::mat4x4 &projectionMatrix, const glm::mat4x4 &viewProjectionMatrix, const float time, const glm::vec2 viewportSize) {
+    auto *uniforms = static_cast<FrameUniforms *>(uploadRing.Allocate(this->uniformBuffer->Get(), 0, sizeof(FrameUniforms)));
+    *uniforms = FrameUniforms{
+        .viewMatrix = cameraViewMatrix,
+        .projectionMatrix = projectionMatrix,
+        .viewProjectionMatrix = viewProjectionMatrix,
+        .time = time,
+        .viewportSize = viewportSize,
+    };
+}
+
+void FrameGlobals::Bind(const wgpu::RenderPassEncoder &renderPass) const {
+    renderPass.SetBindGroup(FrameGlobals::bindGroupIndex, this->bindGroup->Get(), 0, nullptr);
+}
+
+auto FrameGlobals::GetBindGroupLayout() const -> wgpu::BindGroupLayout {
+    return this->bindGroupLayout->Get();
+}
+
+auto FrameGlobals::GetBindGroup() const -> wgpu::BindGroup {
+    return this->bindGroup->Get();
+}
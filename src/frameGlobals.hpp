@@ -0,0 +1,43 @@
+#pragma once
+#include <webgpu/webgpu_cpp.h>
+#include <glm/glm.hpp>
+#include <memory>
+#include "uploadRing.hpp"
+
+// Should be the same as the Frame struct in the shaders.
+struct FrameUniforms {
+    glm::mat4x4 viewMatrix;
+    glm::mat4x4 projectionMatrix;
+    glm::mat4x4 viewProjectionMatrix;
+    float time;
+    float _pad;
+    glm::vec2 viewportSize;  // In pixels, for screen-space sizes
+};
+// Have the compiler check byte alignment
+static_assert(sizeof(FrameUniforms) % 16 == 0);
+
+// Camera and time, written once per frame and bound as group 0 by every render pipeline.
+class FrameGlobals {
+   public:
+    static constexpr uint32_t bindGroupIndex = 0;
+
+    FrameGlobals() = default;
+    ~FrameGlobals() = default;
+    FrameGlobals(const FrameGlobals &) = delete;
+    FrameGlobals(FrameGlobals &&) = delete;
+    auto operator=(const FrameGlobals &) -> FrameGlobals & = delete;
+    auto operator=(FrameGlobals &&) -> FrameGlobals & = delete;
+
+    auto Init(const wgpu::Device &device) -> bool;
+    void Update(UploadRing &uploadRing, const glm::mat4x4 &cameraViewMatrix, const glm::mat4x4 &projectionMatrix, const glm::mat4x4 &viewProjectionMatrix, const float time, const glm::vec2 viewportSize);
+    // Pipelines built against this layout keep the binding across SetPipeline, so a pass binds it once.
+    void Bind(const wgpu::RenderPassEncoder &renderPass) const;
+    auto GetBindGroupLayout() const -> wgpu::BindGroupLayout;
+    // For render bundles, which do not inherit the pass's bind groups.
+    auto GetBindGroup() const -> wgpu::BindGroup;
+
+   private:
+    std::unique_ptr<wgpu::Buffer> uniformBuffer;
+    std::unique_ptr<wgpu::BindGroupLayout> bindGroupLayout;
+    std::unique_ptr<wgpu::BindGroup> bindGroup;
+};
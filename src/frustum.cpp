@@ -0,0 +1,62 @@
+#include "frustum.hpp"
+#include <cmath>
+
+auto ExtractFrustum(const glm::mat4x4 &viewProjectionMatrix) -> Frustum {
+    // Gribb-Hartmann, glm is column-major so gather the rows first.
+    std::array<glm::vec4, 4> rows{};
+    for (int i = 0; i < 4; ++i) {
+        rows[i] = glm::vec4(viewProjectionMatrix[0][i], viewProjectionMatrix[1][i], viewProjectionMatrix[2][i], viewProjectionMatrix[3][i]);
+    }
+
+    // Written for -w..w clip depth. With 0..w depth and with reverse-Z the near slot lands behind the camera,
+    // which only makes it conservative, and an infinite projection has no far plane to extract, rows[3] - rows[2] is the near plane then.
+    Frustum frustum{
+        .planes = {
+            rows[3] + rows[0],
+            rows[3] - rows[0],
+            rows[3] + rows[1],
+            rows[3] - rows[1],
+            rows[3] + rows[2],
+            rows[3] - rows[2],
+        },
+    };
+
+    for (auto &plane : frustum.planes) {
+        plane /= glm::length(glm::vec3(plane));
+    }
+
+    return frustum;
+}
+
+auto IsSphereInFrustum(const Frustum &frustum, const glm::vec3 center, const float radius) -> bool {
+    for (const auto &plane : frustum.planes) {
+        if (glm::dot(glm::vec3(plane), center) + plane.w < -radius) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void CullSpheres(const Frustum &frustum, const float *centerX, const float *centerY, const float *centerZ, const float *radius, const size_t count, uint8_t *visible) {
+    for (size_t i = 0; i < count; ++i) {
+        visible[i] = 1;
+    }
+
+    for (const auto &plane : frustum.planes) {
+        for (size_t i = 0; i < count; ++i) {
+            const float distance = plane.x * centerX[i] + plane.y * centerY[i] + plane.z * centerZ[i] + plane.w;
+            visible[i] &= static_cast<uint8_t>(distance >= -radius[i]);
+        }
+    }
+}
+
+auto CullAnimatedCubeInstances(const Frustum &frustum, const std::vector<AnimatedCubeInstance> &instances, std::vector<AnimatedCubeInstance> &visibleInstances, const float boundingRadius) -> size_t {
+    visibleInstances.clear();
+    for (const auto &instance : instances) {
+        // Animated cubes only rotate about their own centre, so the bounding sphere never moves.
+        if (IsSphereInFrustum(frustum, instance.position, std::abs(instance.scale) * boundingRadius)) {
+            visibleInstances.push_back(instance);
+        }
+    }
+    return visibleInstances.size();
+}
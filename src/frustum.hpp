@@ -0,0 +1,22 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "instancePacking.hpp"
+
+// Six planes facing into the frustum, xyz normal and w distance, normalized so distances are in world units.
+struct Frustum {
+    std::array<glm::vec4, 6> planes;  // Left, right, bottom, top, near, far
+};
+
+auto ExtractFrustum(const glm::mat4x4 &viewProjectionMatrix) -> Frustum;
+auto IsSphereInFrustum(const Frustum &frustum, const glm::vec3 center, const float radius) -> bool;
+// Structure-of-arrays batch of IsSphereInFrustum, branch-free so the inner loop vectorizes.
+// visible[i] is set to 1 for spheres at least partly inside the frustum, 0 otherwise.
+void CullSpheres(const Frustum &frustum, const float *centerX, const float *centerY, const float *centerZ, const float *radius, const size_t count, uint8_t *visible);
+// CPU reference for the compaction done by cube_cull.wgsl, returns the number of visible instances.
+// Keeps the input order, the GPU version appends in whatever order the invocations finish.
+// boundingRadius is the mesh's at scale 1, CullUniforms.boundingRadius on the GPU.
+auto CullAnimatedCubeInstances(const Frustum &frustum, const std::vector<AnimatedCubeInstance> &instances, std::vector<AnimatedCubeInstance> &visibleInstances, const float boundingRadius = cubeBoundingRadius) -> size_t;
@@ -0,0 +1,138 @@
+#include "gpuTimer.hpp"
+#include <iostream>
+#include "profiler.hpp"
+
+namespace {
+constexpr uint64_t sectionSize = 2 * sizeof(uint64_t);
+}  // namespace
+
+auto GpuTimer::Init(const wgpu::Device &device) -> bool {
+    wgpu::QuerySetDescriptor querySetDesc{
+        .label = "GpuTimer",
+        .type = wgpu::QueryType::Timestamp,
+        .count = 2 * GpuTimer::maxSections,
+    };
+    this->querySet = std::make_unique<wgpu::QuerySet>(device.CreateQuerySet(&querySetDesc));
+    if (!this->querySet || !*this->querySet) {
+        std::cerr << "Cannot initialize WebGPU QuerySet" << std::endl;
+        return false;
+    }
+
+    wgpu::BufferDescriptor resolveBufferDesc{
+        .label = "GpuTimer resolve",
+        .usage = wgpu::BufferUsage::QueryResolve | wgpu::BufferUsage::CopySrc,
+        .size = GpuTimer::maxSections * sectionSize,
+        .mappedAtCreation = false,
+    };
+    this->resolveBuffer = std::make_unique<wgpu::Buffer>(device.CreateBuffer(&resolveBufferDesc));
+
+    for (auto &readback : this->readbacks) {
+        wgpu::BufferDescriptor readbackBufferDesc{
+            .label = "GpuTimer readback",
+            .usage = wgpu::BufferUsage::MapRead | wgpu::BufferUsage::CopyDst,
+            .size = GpuTimer::maxSections * sectionSize,
+            .mappedAtCreation = false,
+        };
+        readback.buffer = std::make_unique<wgpu::Buffer>(device.CreateBuffer(&readbackBufferDesc));
+    }
+
+    return this->resolveBuffer != nullptr;
+}
+
+void GpuTimer::BeginFrame() {
+    this->frameReadback = nullptr;
+    if (!this->querySet) {
+        return;
+    }
+
+    for (auto &readback : this->readbacks) {
+        if (!readback.pending) {
+            readback.sectionCount = 0;
+            this->frameReadback = &readback;
+            return;
+        }
+    }
+}
+
+auto GpuTimer::NextSection(const char *name) -> int {
+    if (this->frameReadback == nullptr || this->frameReadback->sectionCount == GpuTimer::maxSections) {
+        return -1;
+    }
+
+    const uint32_t section = this->frameReadback->sectionCount++;
+    this->frameReadback->names[section] = name;
+    return static_cast<int>(section);
+}
+
+auto GpuTimer::GetRenderPassTimestampWrites(const char *name) -> const wgpu::RenderPassTimestampWrites * {
+    const int section = this->NextSection(name);
+    if (section < 0) {
+        return nullptr;
+    }
+
+    this->renderPassTimestampWrites[section] = wgpu::RenderPassTimestampWrites{
+        .querySet = this->querySet->Get(),
+        .beginningOfPassWriteIndex = 2 * (uint32_t)section,
+        .endOfPassWriteIndex = 2 * (uint32_t)section + 1,
+    };
+    return &this->renderPassTimestampWrites[section];
+}
+
+auto GpuTimer::GetComputePassTimestampWrites(const char *name) -> const wgpu::ComputePassTimestampWrites * {
+    const int section = this->NextSection(name);
+    if (section < 0) {
+        return nullptr;
+    }
+
+    this->computePassTimestampWrites[section] = wgpu::ComputePassTimestampWrites{
+        .querySet = this->querySet->Get(),
+        .beginningOfPassWriteIndex = 2 * (uint32_t)section,
+        .endOfPassWriteIndex = 2 * (uint32_t)section + 1,
+    };
+    return &this->computePassTimestampWrites[section];
+}
+
+void GpuTimer::Resolve(const wgpu::CommandEncoder &encoder) {
+    if (this->frameReadback == nullptr || this->frameReadback->sectionCount == 0) {
+        return;
+    }
+
+    const uint32_t queryCount = 2 * this->frameReadback->sectionCount;
+    encoder.ResolveQuerySet(this->querySet->Get(), 0, queryCount, this->resolveBuffer->Get(), 0);
+    encoder.CopyBufferToBuffer(this->resolveBuffer->Get(), 0, this->frameReadback->buffer->Get(), 0, queryCount * sizeof(uint64_t));
+}
+
+void GpuTimer::EndFrame() {
+    if (this->frameReadback == nullptr || this->frameReadback->sectionCount == 0) {
+        return;
+    }
+
+    this->frameReadback->pending = true;
+    this->frameReadback->buffer->MapAsync(wgpu::MapMode::Read, 0, this->frameReadback->sectionCount * sectionSize, GpuTimer::OnMapped, this->frameReadback);
+    this->frameReadback = nullptr;
+}
+
+void GpuTimer::OnMapped(WGPUBufferMapAsyncStatus status, void *userData) {
+    auto *readback = static_cast<Readback *>(userData);
+
+    if (status == WGPUBufferMapAsyncStatus_Success) {
+        const auto *timestamps = static_cast<const uint64_t *>(readback->buffer->GetConstMappedRange(0, readback->sectionCount * sectionSize));
+        Profiler &profiler = Profiler::Get();
+        const double now = profiler.Now();
+
+        for (uint32_t i = 0; timestamps != nullptr && i < readback->sectionCount; ++i) {
+            const uint64_t begin = timestamps[2 * i];
+            const uint64_t end = timestamps[2 * i + 1];
+            // Passes that were skipped after their section was handed out resolve to zero.
+            if (end <= begin) {
+                continue;
+            }
+
+            const double durationMicroseconds = static_cast<double>(end - begin) / 1000.0;
+            profiler.Record(readback->names[i], now - durationMicroseconds, durationMicroseconds, ProfileTrack::Gpu);
+        }
+        readback->buffer->Unmap();
+    }
+
+    readback->pending = false;
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <webgpu/webgpu_cpp.h>
+#include <array>
+#include <cstdint>
+#include <memory>
+
+// Timestamp queries around whole passes, mapped back a few frames later into the Profiler's Gpu track.
+// Needs a device created with wgpu::FeatureName::TimestampQuery.
+class GpuTimer {
+   public:
+    static constexpr uint32_t maxSections = 4;  // Two timestamps each
+    static constexpr size_t readbackCount = 3;  // Frames that can be waiting on MapAsync
+
+    GpuTimer() = default;
+    ~GpuTimer() = default;
+    GpuTimer(const GpuTimer &) = delete;
+    GpuTimer(GpuTimer &&) = delete;
+    auto operator=(const GpuTimer &) -> GpuTimer & = delete;
+    auto operator=(GpuTimer &&) -> GpuTimer & = delete;
+
+    auto Init(const wgpu::Device &device) -> bool;
+    void BeginFrame();
+    // nullptr when timing is off or every readback buffer is still in flight, passes are then untimed.
+    auto GetRenderPassTimestampWrites(const char *name) -> const wgpu::RenderPassTimestampWrites *;
+    auto GetComputePassTimestampWrites(const char *name) -> const wgpu::ComputePassTimestampWrites *;
+    void Resolve(const wgpu::CommandEncoder &encoder);
+    // Call after Submit.
+    void EndFrame();
+
+   private:
+    struct Readback {
+        std::unique_ptr<wgpu::Buffer> buffer;
+        std::array<const char *, maxSections> names{};
+        uint32_t sectionCount = 0;
+        bool pending = false;
+    };
+
+    std::unique_ptr<wgpu::QuerySet> querySet;
+    std::unique_ptr<wgpu::Buffer> resolveBuffer;
+    std::array<Readback, readbackCount> readbacks;
+    Readback *frameReadback = nullptr;
+    std::array<wgpu::RenderPassTimestampWrites, maxSections> renderPassTimestampWrites{};
+    std::array<wgpu::ComputePassTimestampWrites, maxSections> computePassTimestampWrites{};
+
+    auto NextSection(const char *name) -> int;
+    static void OnMapped(WGPUBufferMapAsyncStatus status, void *userData);
+};
@@ -1,48 +1,342 @@
 #include "graphics.hpp"
+#include <algorithm>
 #include "camera.hpp"
+#include "profiler.hpp"
 
-Graphics::Graphics()
-    : line3d_shader(std::make_unique<Line3DShader>(Graphics::line3d_maxLineCount)),
-      cube_shader(std::make_unique<CubeShader>(Graphics::cube_maxCubeCount)) {
-    this->line3d_lines.reserve(Graphics::line3d_maxLineCount);
-    this->cube_instanceModelMatrices.reserve(Graphics::cube_maxCubeCount);
+namespace {
+// Translation and the largest axis scale, so the sphere holds under non-uniform scaling.
+auto GetTransformedSphere(const glm::mat4x4 &transform, const float boundingRadius) -> glm::vec4 {
+    const float scale = std::max({glm::length(glm::vec3(transform[0])), glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2]))});
+    return glm::vec4(glm::vec3(transform[3]), boundingRadius * scale);
 }
+}  // namespace
 
-auto Graphics::InitShaders(const wgpu::Device &device, const wgpu::TextureFormat swapChainFormat, const wgpu::TextureFormat depthTextureFormat, const wgpu::Queue &queue, const uint32_t width, const uint32_t height) -> bool {
-    return this->line3d_shader->Init(device, swapChainFormat, depthTextureFormat, queue, width, height)
-        && this->cube_shader->Init(device, swapChainFormat, depthTextureFormat, queue);
+Graphics::Graphics(CubeInstanceFormat cubeInstanceFormat)
+    : line3d_shader(std::make_unique<Line3DShader>(Graphics::line3d_initialLineCount)),
+      cube_shader(std::make_unique<CubeShader>(Graphics::cube_initialCubeCount, cubeInstanceFormat)),
+      cube_instanceFormat(cubeInstanceFormat),
+      mesh_drawQueue(GetCubeInstanceStride(cubeInstanceFormat)),
+      mesh_staticPacking(cubeInstanceFormat, 0) {
+    this->line3d_lines.reserve(Graphics::line3d_initialLineCount);
+    this->cube_mesh = this->RegisterMesh(BuildCubeMesh());
+    this->rect_mesh = this->cube_mesh;
 }
 
-void Graphics::DrawLine(const glm::vec3 start, const glm::vec3 end, const glm::vec3 /*color*/) {
-    if (this->line3d_lines.size() >= Graphics::line3d_maxLineCount) {
-        return;
+auto Graphics::GetBatch(const MeshId mesh, const MeshMaterial material) -> CubeBatch & {
+    const size_t index = mesh * meshMaterialCount + (size_t)material;
+    if (index >= this->mesh_batches.size()) {
+        this->mesh_batches.resize(index + 1);
+    }
+
+    auto &batch = this->mesh_batches[index];
+    if (batch == nullptr) {
+        batch = std::make_unique<CubeBatch>(this->cube_instanceFormat, mesh == this->cube_mesh ? Graphics::cube_initialCubeCount : 0);
+        batch->SetJobSystem(this->jobSystem);
+    }
+    return *batch;
+}
+
+auto Graphics::InitShaders(const wgpu::Device &device, const wgpu::TextureFormat swapChainFormat, const wgpu::TextureFormat depthTextureFormat, const wgpu::CompareFunction depthCompare, const wgpu::Queue &queue, const FrameGlobals &frameGlobals, UniformArena &uniformArena) -> bool {
+    this->mesh_buffersValid = this->meshRegistry.Init(device) && this->meshRegistry.Upload(queue);
+    return this->mesh_buffersValid
+        && this->line3d_shader->Init(device, swapChainFormat, depthTextureFormat, depthCompare, frameGlobals.GetBindGroupLayout(), uniformArena)
+        && this->cube_shader->Init(device, swapChainFormat, depthTextureFormat, depthCompare, frameGlobals, this->meshRegistry, this->cube_mesh);
+}
+
+void Graphics::AddLineBatch(const glm::mat4x4 &transform, const float width, const size_t lineCount) {
+    if (!this->line3d_batches.empty()) {
+        Line3DBatch &last = this->line3d_batches.back();
+        if (last.transform == transform && last.width == width) {
+            last.lineCount += (uint32_t)lineCount;
+            return;
+        }
     }
+    this->line3d_batches.push_back(Line3DBatch{.transform = transform, .width = width, .firstLine = (uint32_t)this->line3d_lines.size(), .lineCount = (uint32_t)lineCount});
+}
 
-    this->line3d_lines.push_back(Line3D{start, end});
+void Graphics::DrawLine(const glm::vec3 start, const glm::vec3 end, const glm::vec3 color, const float width) {
+    this->AddLineBatch(glm::mat4x4(1.0f), width, 1);
+    this->line3d_lines.push_back(Line3D{.start = start, .end = end, .color = PackLineColor(glm::vec4(color, 1.0f))});
+}
+
+void Graphics::DrawLines(std::span<const Line3D> lines, const glm::mat4x4 &transform, const float width) {
+    if (lines.empty()) {
+        return;
+    }
+    this->AddLineBatch(transform, width, lines.size());
+    this->line3d_lines.insert(this->line3d_lines.end(), lines.begin(), lines.end());
 }
 
 void Graphics::DrawRect(const glm::mat4x4 transform) {
-    if (this->cube_instanceModelMatrices.size() >= Graphics::cube_maxCubeCount) {
+    this->DrawMesh(this->rect_mesh, MeshMaterial::Lit, transform);
+}
+
+void Graphics::DrawRect(const glm::vec3 translation, const glm::quat rotation, const float scale) {
+    this->DrawMesh(this->rect_mesh, MeshMaterial::Lit, translation, rotation, scale);
+}
+
+void Graphics::DrawRects(std::span<const glm::vec3> translations, std::span<const float> scales, const glm::quat rotation) {
+    this->DrawMeshes(this->rect_mesh, MeshMaterial::Lit, translations, scales, rotation);
+}
+
+void Graphics::DrawMesh(const MeshId mesh, const MeshMaterial material, const glm::mat4x4 transform) {
+    this->GetBatch(mesh, material).Add(transform);
+}
+
+void Graphics::DrawMesh(const MeshId mesh, const MeshMaterial material, const glm::vec3 translation, const glm::quat rotation, const float scale) {
+    this->GetBatch(mesh, material).Add(translation, rotation, scale);
+}
+
+void Graphics::DrawMeshes(const MeshId mesh, const MeshMaterial material, std::span<const glm::vec3> translations, std::span<const float> scales, const glm::quat rotation) {
+    this->GetBatch(mesh, material).Add(translations, scales, rotation);
+}
+
+auto Graphics::PackStaticInstances(std::span<const glm::mat4x4> transforms) -> std::span<const std::byte> {
+    this->mesh_staticPacking.Clear();
+    for (const auto &transform : transforms) {
+        this->mesh_staticPacking.Add(transform);
+    }
+    return this->mesh_staticPacking.GetInstanceBytes();
+}
+
+void Graphics::SetStaticSpheres(SceneStaticDraw &draw, std::span<const glm::mat4x4> transforms) {
+    if (draw.spheres.size() == transforms.size()) {
+        this->scene_refit = true;
+    } else {
+        this->scene_rebuild = true;
+    }
+
+    const float boundingRadius = this->meshRegistry.Get(draw.mesh).boundingRadius;
+    draw.spheres.clear();
+    for (const auto &transform : transforms) {
+        draw.spheres.push_back(GetTransformedSphere(transform, boundingRadius));
+    }
+}
+
+auto Graphics::AddStaticMeshes(const MeshId mesh, const MeshMaterial material, std::span<const glm::mat4x4> transforms) -> StaticDrawId {
+    const StaticDrawId id = this->cube_shader->AddStaticDraw(mesh, material, this->PackStaticInstances(transforms));
+    auto &draw = this->scene_staticDraws[id];
+    draw.mesh = mesh;
+    draw.spheres.clear();
+    this->SetStaticSpheres(draw, transforms);
+    this->scene_rebuild = true;
+    return id;
+}
+
+void Graphics::UpdateStaticMeshes(const StaticDrawId id, std::span<const glm::mat4x4> transforms) {
+    this->cube_shader->UpdateStaticDraw(id, this->PackStaticInstances(transforms));
+    this->SetStaticSpheres(this->scene_staticDraws.at(id), transforms);
+}
+
+void Graphics::RemoveStaticMeshes(const StaticDrawId id) {
+    this->cube_shader->RemoveStaticDraw(id);
+    this->scene_staticDraws.erase(id);
+    this->scene_rebuild = true;
+}
+
+void Graphics::SetAnimatedRects(const std::vector<AnimatedCubeInstance> &instances) {
+    this->cube_animatedInstances = instances;
+    this->cube_animatedInstancesDirty = true;
+    this->scene_rebuild = true;
+}
+
+auto Graphics::GetSceneIndex() const -> const Bvh & {
+    return this->scene_index;
+}
+
+auto Graphics::GetSceneInstance(const uint32_t item) const -> SceneInstance {
+    return this->scene_instances[item];
+}
+
+auto Graphics::PickInstance(const Ray &ray, SceneInstance &instance) const -> bool {
+    const BvhHit hit = this->scene_index.Raycast(ray.origin, ray.direction);
+    if (hit.item == BvhHit::noItem) {
+        return false;
+    }
+    instance = this->scene_instances[hit.item];
+    return true;
+}
+
+auto Graphics::GetInstanceSphere(const SceneInstance &instance, glm::vec4 &sphere) const -> bool {
+    if (instance.staticDraw == SceneInstance::animatedRects) {
+        if (instance.index >= this->cube_animatedInstances.size()) {
+            return false;
+        }
+        const AnimatedCubeInstance &rect = this->cube_animatedInstances[instance.index];
+        sphere = glm::vec4(rect.position, this->meshRegistry.Get(this->rect_mesh).boundingRadius * rect.scale);
+        return true;
+    }
+
+    const auto draw = this->scene_staticDraws.find(instance.staticDraw);
+    if (draw == this->scene_staticDraws.end() || instance.index >= draw->second.spheres.size()) {
+        return false;
+    }
+    sphere = draw->second.spheres[instance.index];
+    return true;
+}
+
+void Graphics::UpdateSceneIndex() {
+    if (!this->scene_rebuild && !this->scene_refit) {
         return;
     }
 
-    this->cube_instanceModelMatrices.push_back(transform);
+    // Animated rects only rotate about their position, so their spheres are fixed.
+    const float rectRadius = this->meshRegistry.Get(this->rect_mesh).boundingRadius;
+    this->scene_spheres.clear();
+    for (const auto &instance : this->cube_animatedInstances) {
+        this->scene_spheres.emplace_back(instance.position, rectRadius * instance.scale);
+    }
+    for (const auto &[id, draw] : this->scene_staticDraws) {
+        this->scene_spheres.insert(this->scene_spheres.end(), draw.spheres.begin(), draw.spheres.end());
+    }
+
+    if (this->scene_rebuild) {
+        this->scene_instances.clear();
+        for (uint32_t i = 0; i < this->cube_animatedInstances.size(); ++i) {
+            this->scene_instances.push_back(SceneInstance{.staticDraw = SceneInstance::animatedRects, .index = i});
+        }
+        for (const auto &[id, draw] : this->scene_staticDraws) {
+            for (uint32_t i = 0; i < draw.spheres.size(); ++i) {
+                this->scene_instances.push_back(SceneInstance{.staticDraw = id, .index = i});
+            }
+        }
+        this->scene_index.Build(this->scene_spheres);
+    } else {
+        this->scene_index.Refit(this->scene_spheres);
+    }
+    this->scene_rebuild = false;
+    this->scene_refit = false;
+}
+
+void Graphics::SetFrustumCulling(const bool enabled) {
+    this->cube_frustumCulling = enabled;
+}
+
+void Graphics::SetGpuCulling(const bool enabled) {
+    this->cube_shader->SetGpuCulling(enabled);
+}
+
+void Graphics::SetFrontToBackSorting(const bool enabled) {
+    this->cube_frontToBackSorting = enabled;
+}
+
+void Graphics::SetDepthPrePass(const bool enabled) {
+    this->cube_shader->SetDepthPrePass(enabled);
+}
+
+auto Graphics::RegisterMesh(const MeshData &mesh) -> MeshId {
+    const MeshId id = this->meshRegistry.Add(mesh);
+    const MeshId impostor = this->meshRegistry.Add(BuildImpostorMesh(mesh));
+    this->SetMeshLods(id, {MeshLod{.mesh = impostor, .material = MeshMaterial::Impostor, .maxScreenSize = Graphics::mesh_impostorScreenSize}});
+    return id;
+}
+
+void Graphics::SetMeshLods(const MeshId mesh, std::vector<MeshLod> lods) {
+    if (mesh >= this->mesh_lods.size()) {
+        this->mesh_lods.resize(mesh + 1);
+    }
+    this->mesh_lods[mesh] = std::move(lods);
+}
+
+void Graphics::SetRectMesh(const MeshId mesh) {
+    this->rect_mesh = mesh;
+    this->cube_shader->SetAnimatedMesh(mesh);
+    this->scene_refit = true;
 }
 
-void Graphics::Resize(const uint32_t width, const uint32_t height) {
-    this->line3d_shader->Resize(width, height);
+void Graphics::SetJobSystem(JobSystem *jobSystem) {
+    this->jobSystem = jobSystem;
+    this->scene_index.SetJobSystem(jobSystem);
+    for (auto &batch : this->mesh_batches) {
+        if (batch != nullptr) {
+            batch->SetJobSystem(jobSystem);
+        }
+    }
 }
 
-void Graphics::Render(const wgpu::RenderPassEncoder &renderPass, const wgpu::Queue &queue, const glm::mat4x4 cameraViewMatrix, const glm::mat4x4 projectionMatrix, const float time) {
-    if (!this->line3d_lines.empty()) {
-        this->line3d_shader->UpdateVertexBuffer(queue, this->line3d_lines);
-        this->line3d_shader->Render(renderPass, queue, time);
-        this->line3d_lines.clear();
+void Graphics::Update(UploadRing &uploadRing, const wgpu::Queue &queue, const glm::mat4x4 &viewProjectionMatrix, const float screenScale) {
+    ProfileScope profileScope("Graphics::Update");
+
+    this->mesh_buffersValid = this->meshRegistry.Upload(queue);
+
+    // Rarely rewritten and large, so written directly instead of growing the ring to fit it.
+    if (this->cube_animatedInstancesDirty) {
+        this->cube_shader->UpdateAnimatedBuffers(queue, this->cube_animatedInstances);
+        this->cube_animatedInstancesDirty = false;
+    }
+    this->cube_shader->UploadStaticDraws(queue);
+    this->UpdateSceneIndex();
+
+    this->line3d_shader->UpdateInstanceBuffer(uploadRing, this->line3d_lines);
+    this->line3d_shader->UpdateDraws(viewProjectionMatrix, this->line3d_batches);
+    this->line3d_lines.clear();
+    this->line3d_batches.clear();
+
+    // Culled before the LOD split, while the level batches hold only what was submitted to them,
+    // so instances moved into a lower level are not tested twice.
+    const size_t drawnBatchCount = this->mesh_batches.size();
+    if (this->cube_frustumCulling) {
+        for (size_t index = 0; index < drawnBatchCount; ++index) {
+            CubeBatch *batch = this->mesh_batches[index].get();
+            if (batch != nullptr && !batch->Empty()) {
+                batch->Cull(viewProjectionMatrix, this->meshRegistry.Get((MeshId)(index / meshMaterialCount)).boundingRadius);
+            }
+        }
+    }
+
+    for (size_t index = 0; index < drawnBatchCount; ++index) {
+        CubeBatch *batch = this->mesh_batches[index].get();
+        const auto mesh = (MeshId)(index / meshMaterialCount);
+        if (batch == nullptr || batch->Empty() || mesh >= this->mesh_lods.size() || this->mesh_lods[mesh].empty()) {
+            continue;
+        }
+
+        // Level batches may be created here, which can reallocate mesh_batches but not the batches.
+        this->mesh_lodBatches.clear();
+        this->mesh_lodScreenSizes.clear();
+        for (const auto &lod : this->mesh_lods[mesh]) {
+            this->mesh_lodBatches.push_back(&this->GetBatch(lod.mesh, lod.material));
+            this->mesh_lodScreenSizes.push_back(lod.maxScreenSize);
+        }
+        batch->SplitByScreenSize(viewProjectionMatrix, screenScale, this->meshRegistry.Get(mesh).boundingRadius, this->mesh_lodScreenSizes, this->mesh_lodBatches);
     }
 
-    if (!this->cube_instanceModelMatrices.empty()) {
-        this->cube_shader->UpdateBuffers(queue, this->cube_instanceModelMatrices);
-        this->cube_shader->Render(renderPass, queue, cameraViewMatrix, projectionMatrix, time);
-        this->cube_instanceModelMatrices.clear();
+    // One draw per LOD bucket, DrawQueue merges every batch of the same mesh and material.
+    for (size_t index = 0; index < this->mesh_batches.size(); ++index) {
+        CubeBatch *batch = this->mesh_batches[index].get();
+        if (batch == nullptr || batch->Empty()) {
+            continue;
+        }
+
+        const auto mesh = (MeshId)(index / meshMaterialCount);
+        if (this->cube_frontToBackSorting) {
+            batch->SortFrontToBack(viewProjectionMatrix);  // DrawQueue keeps the order within a draw
+        }
+        this->mesh_drawQueue.Submit((uint32_t)(index % meshMaterialCount), mesh, batch->GetInstanceBytes());
+    }
+
+    this->cube_shader->UpdateBuffers(uploadRing, this->mesh_drawQueue);
+    this->cube_shader->UpdateCullUniforms(uploadRing, viewProjectionMatrix);
+
+    this->mesh_drawQueue.Clear();
+    for (auto &batch : this->mesh_batches) {
+        if (batch != nullptr) {
+            batch->Clear();
+        }
+    }
+}
+
+void Graphics::Prepare(const wgpu::CommandEncoder &encoder, const wgpu::ComputePassTimestampWrites *cullTimestampWrites) {
+    ProfileScope profileScope("Graphics::Prepare");
+
+    this->cube_shader->Cull(encoder, cullTimestampWrites);
+}
+
+void Graphics::Render(const wgpu::RenderPassEncoder &renderPass) {
+    ProfileScope profileScope("Graphics::Render");
+
+    this->line3d_shader->Render(renderPass);
+    if (this->mesh_buffersValid) {
+        this->cube_shader->Render(renderPass);
     }
 }
\ No newline at end of file
@@ -1,36 +1,155 @@
 #pragma once
 #include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <limits>
+#include <map>
+#include <span>
 #include <vector>
+#include "bvh.hpp"
+#include "camera.hpp"
+#include "cubeBatch.hpp"
+#include "drawQueue.hpp"
+#include "frameGlobals.hpp"
+#include "meshRegistry.hpp"
 #include "shaders/cube.hpp"
 #include "shaders/line3d.hpp"
+#include "uniformArena.hpp"
+#include "uploadRing.hpp"
+
+// A lower detail level of a mesh, used for instances whose projected bounding diameter is below maxScreenSize pixels.
+struct MeshLod {
+    MeshId mesh;
+    MeshMaterial material;
+    float maxScreenSize;
+};
+
+// What an item of Graphics::GetSceneIndex refers to, index is the instance within the animated rects or the static draw.
+struct SceneInstance {
+    static constexpr StaticDrawId animatedRects = std::numeric_limits<StaticDrawId>::max();
+
+    StaticDrawId staticDraw;
+    uint32_t index;
+};
 
 class Graphics {
    public:
-    Graphics();
+    Graphics(CubeInstanceFormat cubeInstanceFormat = CubeInstanceFormat::ModelMatrix);
     ~Graphics() = default;
     Graphics(const Graphics &) = delete;
     Graphics(Graphics &&) = delete;
     auto operator=(const Graphics &) -> Graphics & = delete;
     auto operator=(Graphics &&) -> Graphics & = delete;
 
-    void DrawLine(const glm::vec3 start, const glm::vec3 end, const glm::vec3 color);
+    // width is in pixels, independent of distance.
+    void DrawLine(const glm::vec3 start, const glm::vec3 end, const glm::vec3 color, const float width = 1.0f);
+    // Lines in the space of transform. Every run of lines with a distinct transform or width is one draw with its own uniform block,
+    // the blocks share one buffer and are selected with a dynamic offset. Colors come from PackLineColor.
+    void DrawLines(std::span<const Line3D> lines, const glm::mat4x4 &transform, const float width = 1.0f);
     void DrawRect(const glm::mat4x4 transform);
+    void DrawRect(const glm::vec3 translation, const glm::quat rotation, const float scale);
+    void DrawRects(std::span<const glm::vec3> translations, std::span<const float> scales, const glm::quat rotation);
+    // Instances of any registered mesh, merged with every other submission of the same mesh and material into one draw.
+    void DrawMesh(const MeshId mesh, const MeshMaterial material, const glm::mat4x4 transform);
+    void DrawMesh(const MeshId mesh, const MeshMaterial material, const glm::vec3 translation, const glm::quat rotation, const float scale);
+    void DrawMeshes(const MeshId mesh, const MeshMaterial material, std::span<const glm::vec3> translations, std::span<const float> scales, const glm::quat rotation);
+    // Retained until updated or removed and replayed from a render bundle, so unchanged frames cost no CPU work.
+    // Never culled, meant for scenery that rarely changes.
+    auto AddStaticMeshes(const MeshId mesh, const MeshMaterial material, std::span<const glm::mat4x4> transforms) -> StaticDrawId;
+    void UpdateStaticMeshes(const StaticDrawId id, std::span<const glm::mat4x4> transforms);
+    void RemoveStaticMeshes(const StaticDrawId id);
+    // Retained until replaced, animated on the GPU so nothing is uploaded per frame.
+    void SetAnimatedRects(const std::vector<AnimatedCubeInstance> &instances);
+    // Rects drawn this frame that fall outside the camera frustum are dropped before upload.
+    void SetFrustumCulling(const bool enabled);
+    // Animated rects are culled by a compute pass and drawn indirectly.
+    void SetGpuCulling(const bool enabled);
+    // Rects drawn this frame are sorted nearest first after culling, so early-Z rejects more hidden fragments.
+    void SetFrontToBackSorting(const bool enabled);
+    // See CubeShader::SetDepthPrePass.
+    void SetDepthPrePass(const bool enabled);
+    // Shapes usable by the instanced draws, the unit cube is registered up front.
+    // Each one gets an impostor level for instances smaller than a few pixels.
+    auto RegisterMesh(const MeshData &mesh) -> MeshId;
+    // Replaces mesh's lower detail levels, ordered by decreasing maxScreenSize. Levels are not split further.
+    // Only the per-frame draws are bucketed, the retained animated and static instances keep their mesh.
+    void SetMeshLods(const MeshId mesh, std::vector<MeshLod> lods);
+    // Drawn by DrawRect and the animated rects, the unit cube by default.
+    void SetRectMesh(const MeshId mesh);
+    // Bounding spheres of the retained instances, the animated rects and static meshes, for picking and other spatial queries.
+    // Rebuilt by Update when instances are added or removed, refit when they only move.
+    // The per-frame draws are not included, they are culled linearly since a tree would have to be rebuilt every frame.
+    auto GetSceneIndex() const -> const Bvh &;
+    auto GetSceneInstance(const uint32_t item) const -> SceneInstance;
+    // Nearest retained instance whose bounding box the ray enters, as of the last Update. Returns false on a miss.
+    auto PickInstance(const Ray &ray, SceneInstance &instance) const -> bool;
+    // Current bounding sphere of a retained instance, false once it has been removed.
+    auto GetInstanceSphere(const SceneInstance &instance, glm::vec4 &sphere) const -> bool;
+    // Instance generation, packing and CPU culling are split across its workers.
+    void SetJobSystem(JobSystem *jobSystem);
     // void DrawPolygon(int x, int y, const std::vector<glm::vec2> &vertices, glm::vec3 color);
     // void DrawCircle(int x, int y, int radius, float angle, glm::vec3 color);
     // void DrawFillCircle(int x, int y, int radius, glm::vec3 color);
     // void DrawFillRect(int x, int y, int width, int height, glm::vec3 color);
     // void DrawFillPolygon(int x, int y, const std::vector<glm::vec2> &vertices, glm::vec3 color);
 
-    auto InitShaders(const wgpu::Device &device, const wgpu::TextureFormat swapChainFormat, const wgpu::TextureFormat depthTextureFormat, const wgpu::Queue &queue, const uint32_t width, const uint32_t height) -> bool;
-    void Resize(const uint32_t width, const uint32_t height);
-    void Render(const wgpu::RenderPassEncoder &renderPass, const wgpu::Queue &queue, const glm::mat4x4 cameraViewMatrix, const glm::mat4x4 projectionMatrix, const float time);
+    // depthCompare is Greater with reverse-Z, Less otherwise.
+    // Pipelines take FrameGlobals as group 0, per-draw uniforms are pushed into uniformArena, which has to outlive the shaders.
+    auto InitShaders(const wgpu::Device &device, const wgpu::TextureFormat swapChainFormat, const wgpu::TextureFormat depthTextureFormat, const wgpu::CompareFunction depthCompare, const wgpu::Queue &queue, const FrameGlobals &frameGlobals, UniformArena &uniformArena) -> bool;
+    // Culls this frame's draws and stages their instances and uniforms, uploaded when the ring is flushed.
+    // screenScale is from GetScreenScale, for the LOD selection.
+    void Update(UploadRing &uploadRing, const wgpu::Queue &queue, const glm::mat4x4 &viewProjectionMatrix, const float screenScale);
+    // Encodes the work that has to happen before the render pass, such as GPU culling.
+    void Prepare(const wgpu::CommandEncoder &encoder, const wgpu::ComputePassTimestampWrites *cullTimestampWrites = nullptr);
+    // Expects the FrameGlobals bind group to be set on the pass.
+    void Render(const wgpu::RenderPassEncoder &renderPass);
 
    private:
     std::unique_ptr<Line3DShader> line3d_shader;
     std::vector<Line3D> line3d_lines;
-    static constexpr size_t line3d_maxLineCount = 5000;
+    std::vector<Line3DBatch> line3d_batches;
+    static constexpr size_t line3d_initialLineCount = 5000;  // GPU buffers grow past this on demand
+
+    MeshRegistry meshRegistry;
+    // False while a mesh added since the last successful upload is missing from the shared buffers,
+    // the cube draws and bundles are skipped until the retry succeeds.
+    bool mesh_buffersValid = false;
 
     std::unique_ptr<CubeShader> cube_shader;
-    std::vector<glm::mat4x4> cube_instanceModelMatrices;
-    static constexpr size_t cube_maxCubeCount = 5000;
+    MeshId cube_mesh;
+    MeshId rect_mesh;
+    CubeInstanceFormat cube_instanceFormat;
+    // Indexed by mesh * meshMaterialCount + material, created on first use.
+    std::vector<std::unique_ptr<CubeBatch>> mesh_batches;
+    DrawQueue mesh_drawQueue;
+    CubeBatch mesh_staticPacking;
+    JobSystem *jobSystem = nullptr;
+    // Indexed by MeshId.
+    std::vector<std::vector<MeshLod>> mesh_lods;
+    std::vector<CubeBatch *> mesh_lodBatches;
+    std::vector<float> mesh_lodScreenSizes;
+    static constexpr float mesh_impostorScreenSize = 4.0f;
+    std::vector<AnimatedCubeInstance> cube_animatedInstances;
+    bool cube_animatedInstancesDirty = false;
+    bool cube_frustumCulling = true;
+    bool cube_frontToBackSorting = false;
+    static constexpr size_t cube_initialCubeCount = 5000;  // GPU buffers grow past this on demand
+
+    Bvh scene_index;
+    std::vector<SceneInstance> scene_instances;  // Indexed by item
+    std::vector<glm::vec4> scene_spheres;
+    struct SceneStaticDraw {
+        MeshId mesh;
+        std::vector<glm::vec4> spheres;
+    };
+    std::map<StaticDrawId, SceneStaticDraw> scene_staticDraws;  // Ordered so rebuilds number items the same way
+    bool scene_rebuild = false;
+    bool scene_refit = false;
+
+    auto GetBatch(const MeshId mesh, const MeshMaterial material) -> CubeBatch &;
+    // Extends the last line batch when it has the same transform and width, so lines drawn one by one stay one draw.
+    void AddLineBatch(const glm::mat4x4 &transform, const float width, const size_t lineCount);
+    void SetStaticSpheres(SceneStaticDraw &draw, std::span<const glm::mat4x4> transforms);
+    void UpdateSceneIndex();
+    // Valid until the next call.
+    auto PackStaticInstances(std::span<const glm::mat4x4> transforms) -> std::span<const std::byte>;
 };
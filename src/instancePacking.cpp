@@ -0,0 +1,141 @@
+#include "instancePacking.hpp"
+#include <algorithm>
+#include <cmath>
+#if defined(__wasm_simd128__)
+#include <wasm_simd128.h>
+#elif defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+namespace {
+auto PackSnorm16(const float value) -> int16_t {
+    return static_cast<int16_t>(std::round(std::clamp(value, -1.0f, 1.0f) * 32767.0f));
+}
+
+auto UnpackSnorm16(const int16_t value) -> float {
+    return std::max(static_cast<float>(value) / 32767.0f, -1.0f);
+}
+}  // namespace
+
+auto PackCompactCubeInstance(const glm::vec3 translation, const glm::quat rotation, const float scale) -> CompactCubeInstance {
+    const glm::quat normalized = glm::normalize(rotation);
+
+    return CompactCubeInstance{
+        .translation = translation,
+        .scale = scale,
+        .rotation = {PackSnorm16(normalized.x), PackSnorm16(normalized.y), PackSnorm16(normalized.z), PackSnorm16(normalized.w)},
+    };
+}
+
+auto PackCompactCubeInstance(const glm::mat4x4 &transform) -> CompactCubeInstance {
+    const float scale = glm::length(glm::vec3(transform[0]));
+    const glm::quat rotation = glm::quat_cast(glm::mat3x3(transform) / scale);
+
+    return PackCompactCubeInstance(glm::vec3(transform[3]), rotation, scale);
+}
+
+auto UnpackCompactCubeInstance(const CompactCubeInstance &instance) -> glm::mat4x4 {
+    const glm::quat rotation = glm::normalize(glm::quat(
+        UnpackSnorm16(instance.rotation[3]),
+        UnpackSnorm16(instance.rotation[0]),
+        UnpackSnorm16(instance.rotation[1]),
+        UnpackSnorm16(instance.rotation[2])));
+
+    glm::mat4x4 transform = glm::mat4x4(glm::mat3_cast(rotation) * instance.scale);
+    transform[3] = glm::vec4(instance.translation, 1.0f);
+
+    return transform;
+}
+
+void BuildInstanceMatrices(std::span<const glm::vec3> positions, std::span<const float> scales, const glm::quat rotation, std::span<glm::mat4x4> out) {
+    const glm::mat3x3 rotationMatrix = glm::mat3_cast(rotation);
+    const size_t count = out.size();
+
+#if defined(__wasm_simd128__)
+    const v128_t column0 = wasm_f32x4_make(rotationMatrix[0].x, rotationMatrix[0].y, rotationMatrix[0].z, 0.0f);
+    const v128_t column1 = wasm_f32x4_make(rotationMatrix[1].x, rotationMatrix[1].y, rotationMatrix[1].z, 0.0f);
+    const v128_t column2 = wasm_f32x4_make(rotationMatrix[2].x, rotationMatrix[2].y, rotationMatrix[2].z, 0.0f);
+    for (size_t i = 0; i < count; ++i) {
+        auto *matrix = reinterpret_cast<float *>(&out[i]);
+        const v128_t scale = wasm_f32x4_splat(scales[i]);
+        wasm_v128_store(matrix + 0, wasm_f32x4_mul(column0, scale));
+        wasm_v128_store(matrix + 4, wasm_f32x4_mul(column1, scale));
+        wasm_v128_store(matrix + 8, wasm_f32x4_mul(column2, scale));
+        wasm_v128_store(matrix + 12, wasm_f32x4_make(positions[i].x, positions[i].y, positions[i].z, 1.0f));
+    }
+#elif defined(__SSE__)
+    const __m128 column0 = _mm_setr_ps(rotationMatrix[0].x, rotationMatrix[0].y, rotationMatrix[0].z, 0.0f);
+    const __m128 column1 = _mm_setr_ps(rotationMatrix[1].x, rotationMatrix[1].y, rotationMatrix[1].z, 0.0f);
+    const __m128 column2 = _mm_setr_ps(rotationMatrix[2].x, rotationMatrix[2].y, rotationMatrix[2].z, 0.0f);
+    for (size_t i = 0; i < count; ++i) {
+        auto *matrix = reinterpret_cast<float *>(&out[i]);
+        const __m128 scale = _mm_set1_ps(scales[i]);
+        _mm_storeu_ps(matrix + 0, _mm_mul_ps(column0, scale));
+        _mm_storeu_ps(matrix + 4, _mm_mul_ps(column1, scale));
+        _mm_storeu_ps(matrix + 8, _mm_mul_ps(column2, scale));
+        _mm_storeu_ps(matrix + 12, _mm_setr_ps(positions[i].x, positions[i].y, positions[i].z, 1.0f));
+    }
+#else
+    for (size_t i = 0; i < count; ++i) {
+        glm::mat4x4 transform = glm::mat4x4(rotationMatrix * scales[i]);
+        transform[3] = glm::vec4(positions[i], 1.0f);
+        out[i] = transform;
+    }
+#endif
+}
+
+void PackCompactCubeInstances(std::span<const glm::vec3> positions, std::span<const float> scales, const glm::quat rotation, std::span<CompactCubeInstance> out) {
+    // The rotation is shared, so only pack it once.
+    const CompactCubeInstance packedRotation = PackCompactCubeInstance(glm::vec3(0.0f), rotation, 1.0f);
+    const size_t count = out.size();
+    size_t i = 0;
+
+    // Four instances at a time: three loads cover four tightly packed positions, one more their scales,
+    // and shuffles merge them into the translation and scale half of each CompactCubeInstance.
+    static_assert(sizeof(glm::vec3) == 3 * sizeof(float));
+#if defined(__wasm_simd128__)
+    for (; i + 4 <= count; i += 4) {
+        const auto *position = reinterpret_cast<const float *>(&positions[i]);
+        const v128_t a = wasm_v128_load(position + 0);  // x0 y0 z0 x1
+        const v128_t b = wasm_v128_load(position + 4);  // y1 z1 x2 y2
+        const v128_t c = wasm_v128_load(position + 8);  // z2 x3 y3 z3
+        const v128_t scale = wasm_v128_load(&scales[i]);
+        const v128_t translationAndScale[4]{
+            wasm_i32x4_shuffle(a, scale, 0, 1, 2, 4),
+            wasm_i32x4_shuffle(wasm_i32x4_shuffle(a, b, 3, 4, 5, 0), scale, 0, 1, 2, 5),
+            wasm_i32x4_shuffle(wasm_i32x4_shuffle(b, c, 2, 3, 4, 0), scale, 0, 1, 2, 6),
+            wasm_i32x4_shuffle(c, scale, 1, 2, 3, 7),
+        };
+        for (int k = 0; k < 4; ++k) {
+            wasm_v128_store(&out[i + k].translation, translationAndScale[k]);
+            out[i + k].rotation = packedRotation.rotation;
+        }
+    }
+#elif defined(__SSE__)
+    for (; i + 4 <= count; i += 4) {
+        const auto *position = reinterpret_cast<const float *>(&positions[i]);
+        const __m128 a = _mm_loadu_ps(position + 0);  // x0 y0 z0 x1
+        const __m128 b = _mm_loadu_ps(position + 4);  // y1 z1 x2 y2
+        const __m128 c = _mm_loadu_ps(position + 8);  // z2 x3 y3 z3
+        const __m128 scale = _mm_loadu_ps(&scales[i]);
+        const __m128 translationAndScale[4]{
+            _mm_shuffle_ps(a, _mm_shuffle_ps(a, scale, _MM_SHUFFLE(0, 0, 2, 2)), _MM_SHUFFLE(2, 0, 1, 0)),
+            _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 3, 3)), _mm_shuffle_ps(b, scale, _MM_SHUFFLE(1, 1, 1, 1)), _MM_SHUFFLE(2, 0, 2, 0)),
+            _mm_shuffle_ps(b, _mm_shuffle_ps(c, scale, _MM_SHUFFLE(2, 2, 0, 0)), _MM_SHUFFLE(2, 0, 3, 2)),
+            _mm_shuffle_ps(c, _mm_shuffle_ps(c, scale, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(2, 0, 2, 1)),
+        };
+        for (int k = 0; k < 4; ++k) {
+            _mm_storeu_ps(reinterpret_cast<float *>(&out[i + k].translation), translationAndScale[k]);
+            out[i + k].rotation = packedRotation.rotation;
+        }
+    }
+#endif
+
+    for (; i < count; ++i) {
+        out[i] = CompactCubeInstance{
+            .translation = positions[i],
+            .scale = scales[i],
+            .rotation = packedRotation.rotation,
+        };
+    }
+}
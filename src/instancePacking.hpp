@@ -0,0 +1,51 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+// Per-frame instance layout, fixed when the pipeline is created.
+enum class CubeInstanceFormat {
+    ModelMatrix,  // glm::mat4x4, 64 bytes
+    Compact,      // CompactCubeInstance, 24 bytes
+};
+
+// Compact cube instance, 24 bytes instead of the 64 of a full model matrix.
+// Should be the same as the vs_compact input in cube.wgsl.
+struct CompactCubeInstance {
+    glm::vec3 translation;
+    float scale;
+    std::array<int16_t, 4> rotation;  // Unit quaternion xyzw, Snorm16x4
+};
+static_assert(sizeof(CompactCubeInstance) == 24);
+
+// Static per-instance data for cubes animated in the vertex shader, see vs_animated in cube.wgsl.
+// Also read as a storage buffer by cube_cull.wgsl, so keep it 16-byte aligned.
+struct AnimatedCubeInstance {
+    glm::vec3 position;
+    float scale;
+    glm::vec3 rotationAxis;
+    float rotationSpeed;  // Radians per second
+};
+static_assert(sizeof(AnimatedCubeInstance) == 32);
+
+constexpr auto GetCubeInstanceStride(const CubeInstanceFormat format) -> size_t {
+    return format == CubeInstanceFormat::Compact ? sizeof(CompactCubeInstance) : sizeof(glm::mat4x4);
+}
+
+// Unit cube vertices are at +-1, so its bounding sphere has radius sqrt(3) before scaling.
+constexpr float cubeBoundingRadius = 1.7320508f;
+
+auto PackCompactCubeInstance(const glm::vec3 translation, const glm::quat rotation, const float scale) -> CompactCubeInstance;
+// Assumes a uniform scale and no shear, which is all a CompactCubeInstance can represent.
+auto PackCompactCubeInstance(const glm::mat4x4 &transform) -> CompactCubeInstance;
+auto UnpackCompactCubeInstance(const CompactCubeInstance &instance) -> glm::mat4x4;
+
+// Batch versions for instances sharing one rotation, out must be as long as positions and scales. Both use wasm SIMD128 or SSE when the target has it.
+// BuildInstanceMatrices composes TRS directly, bit-identical to mat3_cast(rotation) * scale with the translation in column 3.
+// Its vectors span the columns of one matrix, which already matches the output layout. Only the ModelMatrix format uses it.
+// PackCompactCubeInstances vectorizes across four instances at a time, it is the default Compact format's path.
+void BuildInstanceMatrices(std::span<const glm::vec3> positions, std::span<const float> scales, const glm::quat rotation, std::span<glm::mat4x4> out);
+void PackCompactCubeInstances(std::span<const glm::vec3> positions, std::span<const float> scales, const glm::quat rotation, std::span<CompactCubeInstance> out);
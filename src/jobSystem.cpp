@@ -0,0 +1,130 @@
+#include "jobSystem.hpp"
+#include <algorithm>
+
+JobSystem::JobSystem(const size_t workerCount) {
+    for (size_t i = 0; i <= workerCount; ++i) {
+        this->queues.push_back(std::make_unique<Queue>());
+    }
+
+    for (size_t i = 1; i <= workerCount; ++i) {
+        this->workers.emplace_back([this, i] { this->WorkerLoop(i); });
+    }
+}
+
+JobSystem::~JobSystem() {
+    {
+        std::lock_guard<std::mutex> lock(this->wakeMutex);
+        this->stopping = true;
+    }
+    this->wake.notify_all();
+
+    for (auto &worker : this->workers) {
+        worker.join();
+    }
+}
+
+auto JobSystem::DefaultWorkerCount() -> size_t {
+#if defined(__EMSCRIPTEN__) && !defined(__EMSCRIPTEN_PTHREADS__)
+    return 0;
+#else
+    const size_t hardwareThreads = std::thread::hardware_concurrency();
+    return hardwareThreads > 1 ? hardwareThreads - 1 : 0;
+#endif
+}
+
+auto JobSystem::GetWorkerCount() const -> size_t {
+    return this->workers.size();
+}
+
+auto JobSystem::TryRunTask(const size_t queueIndex) -> bool {
+    Task task{};
+    bool found = false;
+
+    // Own queue from the back, keeps recently queued chunks warm in this core's cache.
+    {
+        Queue &queue = *this->queues[queueIndex];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.tasks.empty()) {
+            task = queue.tasks.back();
+            queue.tasks.pop_back();
+            found = true;
+        }
+    }
+
+    // Steal from the front of the others.
+    for (size_t i = 1; !found && i < this->queues.size(); ++i) {
+        Queue &queue = *this->queues[(queueIndex + i) % this->queues.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.tasks.empty()) {
+            task = queue.tasks.front();
+            queue.tasks.pop_front();
+            found = true;
+        }
+    }
+
+    if (!found) {
+        return false;
+    }
+
+    this->queuedTaskCount.fetch_sub(1, std::memory_order_relaxed);
+    (*task.job)(task.begin, task.end);
+    task.remaining->fetch_sub(1, std::memory_order_release);
+
+    return true;
+}
+
+void JobSystem::WorkerLoop(const size_t queueIndex) {
+    while (true) {
+        if (this->TryRunTask(queueIndex)) {
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(this->wakeMutex);
+        this->wake.wait(lock, [this] { return this->stopping || this->queuedTaskCount.load(std::memory_order_relaxed) > 0; });
+        if (this->stopping) {
+            return;
+        }
+    }
+}
+
+void JobSystem::ParallelFor(const size_t count, const size_t chunkSize, const Job &job) {
+    if (count == 0) {
+        return;
+    }
+
+    const size_t chunk = std::max<size_t>(chunkSize, 1);
+    if (this->workers.empty() || count <= chunk) {
+        job(0, count);
+        return;
+    }
+
+    const size_t taskCount = (count + chunk - 1) / chunk;
+    std::atomic<size_t> remaining = taskCount;
+
+    {
+        // Counted before queueing so a worker popping early never takes the count below zero.
+        // Taken under wakeMutex so a worker cannot check the predicate between the increment and the notify and miss it.
+        std::lock_guard<std::mutex> lock(this->wakeMutex);
+        this->queuedTaskCount.fetch_add(taskCount, std::memory_order_relaxed);
+    }
+
+    for (size_t i = 0; i < taskCount; ++i) {
+        Queue &queue = *this->queues[i % this->queues.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back(Task{
+            .job = &job,
+            .begin = i * chunk,
+            .end = std::min(count, (i + 1) * chunk),
+            .remaining = &remaining,
+        });
+    }
+    this->wake.notify_all();
+
+    while (this->TryRunTask(0)) {
+    }
+
+    // Whatever is left is already running on a worker.
+    while (remaining.load(std::memory_order_acquire) > 0) {
+        std::this_thread::yield();
+    }
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed pool of workers, each with its own queue, stealing from the others when theirs runs dry.
+// With no workers everything runs inline on the calling thread, which is what single-threaded wasm builds get.
+class JobSystem {
+   public:
+    using Job = std::function<void(size_t begin, size_t end)>;
+
+    explicit JobSystem(const size_t workerCount);
+    ~JobSystem();
+    JobSystem(const JobSystem &) = delete;
+    JobSystem(JobSystem &&) = delete;
+    auto operator=(const JobSystem &) -> JobSystem & = delete;
+    auto operator=(JobSystem &&) -> JobSystem & = delete;
+
+    // One less than the hardware threads so the main thread keeps a core, 0 when the build has no threads.
+    static auto DefaultWorkerCount() -> size_t;
+    auto GetWorkerCount() const -> size_t;
+    // Calls job over chunks covering [0, count) on the workers and the calling thread, returns once all are done.
+    // Not reentrant, job must not call ParallelFor.
+    void ParallelFor(const size_t count, const size_t chunkSize, const Job &job);
+
+   private:
+    struct Task {
+        const Job *job;
+        size_t begin;
+        size_t end;
+        std::atomic<size_t> *remaining;
+    };
+
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    // Index 0 belongs to the thread calling ParallelFor, workers own the rest.
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+    std::mutex wakeMutex;
+    std::condition_variable wake;
+    std::atomic<size_t> queuedTaskCount = 0;
+    bool stopping = false;
+
+    auto TryRunTask(const size_t queueIndex) -> bool;
+    void WorkerLoop(const size_t queueIndex);
+};
@@ -0,0 +1,78 @@
+#include "mesh.hpp"
+#include <algorithm>
+#include <array>
+
+namespace {
+// Same corner colors as the old triangle strip cube.
+auto CubeCornerColor(const glm::vec3 corner) -> glm::vec3 {
+    if (corner.z > 0) {
+        if (corner.y > 0) {
+            return corner.x < 0 ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+        }
+        return corner.x < 0 ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(1.0f, 0.0f, 1.0f);
+    }
+    if (corner.y > 0) {
+        return glm::vec3(1.0f, 0.0f, 1.0f);
+    }
+    return corner.x < 0 ? glm::vec3(0.5f, 0.5f, 0.5f) : glm::vec3(1.0f, 1.0f, 0.0f);
+}
+}  // namespace
+
+auto ComputeBoundingRadius(const MeshData &mesh) -> float {
+    float radius = 0;
+    for (const auto &vertex : mesh.vertices) {
+        radius = std::max(radius, glm::length(vertex.position));
+    }
+    return radius;
+}
+
+auto BuildCubeMesh() -> MeshData {
+    // Face normal and a tangent along it, the bitangent follows so tangent x bitangent = normal.
+    const std::array<std::array<glm::vec3, 2>, 6> faces{{
+        {glm::vec3(1, 0, 0), glm::vec3(0, 1, 0)},
+        {glm::vec3(-1, 0, 0), glm::vec3(0, 1, 0)},
+        {glm::vec3(0, 1, 0), glm::vec3(0, 0, 1)},
+        {glm::vec3(0, -1, 0), glm::vec3(0, 0, 1)},
+        {glm::vec3(0, 0, 1), glm::vec3(1, 0, 0)},
+        {glm::vec3(0, 0, -1), glm::vec3(1, 0, 0)},
+    }};
+
+    MeshData mesh;
+    mesh.vertices.reserve(faces.size() * 4);
+    mesh.indices.reserve(faces.size() * 6);
+    for (const auto &[normal, tangent] : faces) {
+        const glm::vec3 bitangent = glm::cross(normal, tangent);
+        const auto first = (MeshIndex)mesh.vertices.size();
+
+        // Counter-clockwise around the normal.
+        for (const glm::vec2 corner : {glm::vec2(-1, -1), glm::vec2(1, -1), glm::vec2(1, 1), glm::vec2(-1, 1)}) {
+            const glm::vec3 position = normal + corner.x * tangent + corner.y * bitangent;
+            mesh.vertices.push_back(MeshVertex{.position = position, .normal = normal, .color = CubeCornerColor(position)});
+        }
+
+        for (const MeshIndex index : {0, 1, 2, 0, 2, 3}) {
+            mesh.indices.push_back((MeshIndex)(first + index));
+        }
+    }
+
+    return mesh;
+}
+
+auto BuildImpostorMesh(const MeshData &source) -> MeshData {
+    glm::vec3 color(0.0f);
+    for (const auto &vertex : source.vertices) {
+        color += vertex.color;
+    }
+    color /= std::max<float>(1.0f, (float)source.vertices.size());
+
+    // Between the inscribed and the bounding square of a cube's silhouette.
+    const float halfSize = ComputeBoundingRadius(source) * 0.7f;
+    const glm::vec3 normal(0.0f, 0.0f, 1.0f);
+
+    MeshData mesh;
+    for (const glm::vec2 corner : {glm::vec2(-1, -1), glm::vec2(1, -1), glm::vec2(1, 1), glm::vec2(-1, 1)}) {
+        mesh.vertices.push_back(MeshVertex{.position = glm::vec3(corner.x * halfSize, corner.y * halfSize, 0.0f), .normal = normal, .color = color});
+    }
+    mesh.indices = {0, 1, 2, 0, 2, 3};
+    return mesh;
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+
+// Should be the same as the mesh vertex input in the shaders.
+struct MeshVertex {
+    glm::vec3 position;
+    glm::vec3 normal;
+    glm::vec3 color;
+};
+
+using MeshIndex = uint16_t;  // Small shapes only, wgpu::IndexFormat::Uint16
+
+// Triangle list, counter-clockwise seen from outside.
+struct MeshData {
+    std::vector<MeshVertex> vertices;
+    std::vector<MeshIndex> indices;
+};
+
+// Of the sphere around the origin containing every vertex, the culling bound at scale 1.
+auto ComputeBoundingRadius(const MeshData &mesh) -> float;
+
+// Corners at +-1, four vertices per face so every face has its own normal.
+auto BuildCubeMesh() -> MeshData;
+// Lowest detail level of source: a quad in the xy plane facing +z, turned towards the camera by the
+// impostor vertex shaders. Sized to roughly the source's average silhouette, colored with its average color.
+auto BuildImpostorMesh(const MeshData &source) -> MeshData;
@@ -0,0 +1,84 @@
+#include "meshRegistry.hpp"
+#include <iostream>
+
+auto MeshRegistry::Init(const wgpu::Device &device) -> bool {
+    this->device = device;
+    return true;
+}
+
+auto MeshRegistry::Add(const MeshData &mesh) -> MeshId {
+    this->ranges.push_back(MeshRange{
+        .indexCount = (uint32_t)mesh.indices.size(),
+        .firstIndex = (uint32_t)this->indices.size(),
+        .baseVertex = (int32_t)this->vertices.size(),
+        .boundingRadius = ComputeBoundingRadius(mesh),
+    });
+    this->vertices.insert(this->vertices.end(), mesh.vertices.begin(), mesh.vertices.end());
+    this->indices.insert(this->indices.end(), mesh.indices.begin(), mesh.indices.end());
+    this->dirty = true;
+
+    return (MeshId)(this->ranges.size() - 1);
+}
+
+auto MeshRegistry::Upload(const wgpu::Queue &queue) -> bool {
+    if (!this->dirty) {
+        return true;
+    }
+
+    // WriteBuffer sizes must be a multiple of 4, pad the 16-bit indices.
+    if (this->indices.size() % 2 != 0) {
+        this->indices.push_back(0);
+    }
+
+    wgpu::BufferDescriptor vertexBufferDesc{
+        .label = "mesh_vertex_buffer",
+        .usage = wgpu::BufferUsage::CopyDst | wgpu::BufferUsage::Vertex,
+        .size = (uint64_t)(this->vertices.size() * sizeof(MeshVertex)),
+        .mappedAtCreation = false,
+    };
+    auto vertexBuffer = std::make_unique<wgpu::Buffer>(this->device.CreateBuffer(&vertexBufferDesc));
+
+    wgpu::BufferDescriptor indexBufferDesc{
+        .label = "mesh_index_buffer",
+        .usage = wgpu::BufferUsage::CopyDst | wgpu::BufferUsage::Index,
+        .size = (uint64_t)(this->indices.size() * sizeof(MeshIndex)),
+        .mappedAtCreation = false,
+    };
+    auto indexBuffer = std::make_unique<wgpu::Buffer>(this->device.CreateBuffer(&indexBufferDesc));
+
+    if (!*vertexBuffer || !*indexBuffer) {
+        std::cerr << "Cannot allocate WebGPU mesh buffers" << std::endl;
+        return false;
+    }
+
+    queue.WriteBuffer(vertexBuffer->Get(), 0, this->vertices.data(), vertexBufferDesc.size);
+    queue.WriteBuffer(indexBuffer->Get(), 0, this->indices.data(), indexBufferDesc.size);
+    this->vertexBuffer = std::move(vertexBuffer);
+    this->indexBuffer = std::move(indexBuffer);
+    this->dirty = false;
+    this->version++;
+
+    return true;
+}
+
+void MeshRegistry::Bind(const wgpu::RenderPassEncoder &renderPass) const {
+    renderPass.SetVertexBuffer(0, this->vertexBuffer->Get());
+    renderPass.SetIndexBuffer(this->indexBuffer->Get(), wgpu::IndexFormat::Uint16);
+}
+
+void MeshRegistry::Bind(const wgpu::RenderBundleEncoder &renderBundle) const {
+    renderBundle.SetVertexBuffer(0, this->vertexBuffer->Get());
+    renderBundle.SetIndexBuffer(this->indexBuffer->Get(), wgpu::IndexFormat::Uint16);
+}
+
+auto MeshRegistry::Get(const MeshId mesh) const -> const MeshRange & {
+    return this->ranges[mesh];
+}
+
+auto MeshRegistry::Size() const -> size_t {
+    return this->ranges.size();
+}
+
+auto MeshRegistry::GetVersion() const -> uint32_t {
+    return this->version;
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <webgpu/webgpu_cpp.h>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "mesh.hpp"
+
+using MeshId = uint32_t;
+
+// Where a mesh lives in the shared buffers, in DrawIndexed terms.
+struct MeshRange {
+    uint32_t indexCount;
+    uint32_t firstIndex;
+    int32_t baseVertex;
+    float boundingRadius;  // See ComputeBoundingRadius
+};
+
+// Every registered mesh shares one vertex and one index buffer, so switching meshes needs no rebinding.
+class MeshRegistry {
+   public:
+    MeshRegistry() = default;
+    ~MeshRegistry() = default;
+    MeshRegistry(const MeshRegistry &) = delete;
+    MeshRegistry(MeshRegistry &&) = delete;
+    auto operator=(const MeshRegistry &) -> MeshRegistry & = delete;
+    auto operator=(MeshRegistry &&) -> MeshRegistry & = delete;
+
+    auto Init(const wgpu::Device &device) -> bool;
+    // Get works right away, drawing the mesh has to wait for the next successful Upload to copy it into the shared buffers.
+    auto Add(const MeshData &mesh) -> MeshId;
+    // Recreates the shared buffers when meshes were added since the last call, bumping the version.
+    // Returns false when they cannot be allocated: the previous buffers are kept, without the new meshes, and the next call retries.
+    auto Upload(const wgpu::Queue &queue) -> bool;
+    void Bind(const wgpu::RenderPassEncoder &renderPass) const;
+    void Bind(const wgpu::RenderBundleEncoder &renderBundle) const;
+    auto Get(const MeshId mesh) const -> const MeshRange &;
+    auto Size() const -> size_t;
+    // Changes whenever the shared buffers are recreated, render bundles recorded with the old ones have to be re-recorded.
+    auto GetVersion() const -> uint32_t;
+
+   private:
+    wgpu::Device device;
+    std::vector<MeshVertex> vertices;
+    std::vector<MeshIndex> indices;
+    std::vector<MeshRange> ranges;
+    std::unique_ptr<wgpu::Buffer> vertexBuffer;
+    std::unique_ptr<wgpu::Buffer> indexBuffer;
+    bool dirty = false;
+    uint32_t version = 0;
+};
@@ -0,0 +1,118 @@
+#include "profiler.hpp"
+#include <algorithm>
+#include <cmath>
+
+Profiler::Profiler() : epoch(std::chrono::steady_clock::now()) {
+    for (auto &frame : this->frames) {
+        frame.samples.reserve(32);
+    }
+}
+
+auto Profiler::Get() -> Profiler & {
+    static Profiler profiler;
+    return profiler;
+}
+
+auto Profiler::Now() const -> double {
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - this->epoch).count();
+}
+
+void Profiler::BeginFrame() {
+    this->current = (this->current + 1) % this->frames.size();
+
+    Frame &frame = this->frames[this->current];
+    frame.index = ++this->frameCount;
+    frame.samples.clear();
+
+    this->frameStart = this->Now();
+}
+
+void Profiler::EndFrame() {
+    this->Record(Profiler::frameSampleName, this->frameStart, this->Now() - this->frameStart);
+}
+
+void Profiler::Record(const char *name, const double startMicroseconds, const double durationMicroseconds, const ProfileTrack track) {
+    this->frames[this->current].samples.push_back(ProfileSample{
+        .name = name,
+        .startMicroseconds = startMicroseconds,
+        .durationMicroseconds = durationMicroseconds,
+        .track = track,
+    });
+}
+
+auto Profiler::GetStats(std::string_view name) const -> ProfileStats {
+    std::vector<double> durations;
+    for (const auto &frame : this->frames) {
+        for (const auto &sample : frame.samples) {
+            if (name == sample.name) {
+                durations.push_back(sample.durationMicroseconds);
+            }
+        }
+    }
+
+    if (durations.empty()) {
+        return ProfileStats{};
+    }
+
+    std::sort(durations.begin(), durations.end());
+
+    double sum = 0;
+    for (const double duration : durations) {
+        sum += duration;
+    }
+
+    const auto p99Index = static_cast<size_t>(std::ceil(0.99 * static_cast<double>(durations.size()))) - 1;
+
+    return ProfileStats{
+        .count = durations.size(),
+        .minMicroseconds = durations.front(),
+        .avgMicroseconds = sum / static_cast<double>(durations.size()),
+        .p99Microseconds = durations[p99Index],
+    };
+}
+
+void Profiler::WriteSummary(std::ostream &out) const {
+    std::vector<std::string_view> names;
+    for (const auto &frame : this->frames) {
+        for (const auto &sample : frame.samples) {
+            if (std::find(names.begin(), names.end(), sample.name) == names.end()) {
+                names.emplace_back(sample.name);
+            }
+        }
+    }
+
+    out << "phase, count, min us, avg us, p99 us\n";
+    for (const auto name : names) {
+        const ProfileStats stats = this->GetStats(name);
+        out << name << ", " << stats.count << ", " << stats.minMicroseconds << ", " << stats.avgMicroseconds << ", " << stats.p99Microseconds << "\n";
+    }
+}
+
+void Profiler::WriteChromeTrace(std::ostream &out) const {
+    out << "{\"traceEvents\":[";
+
+    bool first = true;
+    // Oldest frame first, it is the one after current in the ring.
+    for (size_t i = 1; i <= this->frames.size(); ++i) {
+        const Frame &frame = this->frames[(this->current + i) % this->frames.size()];
+        for (const auto &sample : frame.samples) {
+            out << (first ? "" : ",")
+                << "\n{\"name\":\"" << sample.name
+                << "\",\"ph\":\"X\",\"ts\":" << sample.startMicroseconds
+                << ",\"dur\":" << sample.durationMicroseconds
+                << ",\"pid\":1,\"tid\":" << static_cast<uint32_t>(sample.track)
+                << ",\"args\":{\"frame\":" << frame.index << "}}";
+            first = false;
+        }
+    }
+
+    out << "\n]}\n";
+}
+
+ProfileScope::ProfileScope(const char *name) : name(name), start(Profiler::Get().Now()) {
+}
+
+ProfileScope::~ProfileScope() {
+    Profiler &profiler = Profiler::Get();
+    profiler.Record(this->name, this->start, profiler.Now() - this->start);
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string_view>
+#include <vector>
+
+// Shown as separate threads in the Chrome trace.
+enum class ProfileTrack : uint32_t {
+    Cpu = 1,
+    Gpu = 2,  // Arrives frames late and in the GPU clock domain, only the duration is meaningful.
+};
+
+struct ProfileSample {
+    const char *name;  // Not copied, use string literals.
+    double startMicroseconds;
+    double durationMicroseconds;
+    ProfileTrack track;
+};
+
+struct ProfileStats {
+    size_t count = 0;
+    double minMicroseconds = 0;
+    double avgMicroseconds = 0;
+    double p99Microseconds = 0;
+};
+
+// Named phase durations for the last frameWindow frames, read back as stats or a Chrome trace.
+// Not thread-safe, only record from the main loop.
+class Profiler {
+   public:
+    static constexpr size_t frameWindow = 240;
+    static constexpr const char *frameSampleName = "Frame";
+
+    Profiler();
+    ~Profiler() = default;
+    Profiler(const Profiler &) = delete;
+    Profiler(Profiler &&) = delete;
+    auto operator=(const Profiler &) -> Profiler & = delete;
+    auto operator=(Profiler &&) -> Profiler & = delete;
+
+    static auto Get() -> Profiler &;
+
+    void BeginFrame();
+    void EndFrame();
+    void Record(const char *name, const double startMicroseconds, const double durationMicroseconds, const ProfileTrack track = ProfileTrack::Cpu);
+    auto Now() const -> double;
+    auto GetStats(std::string_view name) const -> ProfileStats;
+    void WriteSummary(std::ostream &out) const;
+    // Trace Event Format, open with chrome://tracing or ui.perfetto.dev.
+    void WriteChromeTrace(std::ostream &out) const;
+
+   private:
+    struct Frame {
+        uint64_t index = 0;
+        std::vector<ProfileSample> samples;
+    };
+
+    std::chrono::steady_clock::time_point epoch;
+    std::array<Frame, frameWindow> frames;
+    size_t current = 0;
+    uint64_t frameCount = 0;
+    double frameStart = 0;
+};
+
+// Records the time between construction and destruction as one sample.
+class ProfileScope {
+   public:
+    explicit ProfileScope(const char *name);
+    ~ProfileScope();
+    ProfileScope(const ProfileScope &) = delete;
+    ProfileScope(ProfileScope &&) = delete;
+    auto operator=(const ProfileScope &) -> ProfileScope & = delete;
+    auto operator=(ProfileScope &&) -> ProfileScope & = delete;
+
+   private:
+    const char *name;
+    double start;
+};
@@ -3,6 +3,7 @@
 #include <webgpu/webgpu_cpp.h>
 #include <glm/ext/matrix_transform.hpp>
 #include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
 #include <clocale>
 #include <cmath>
 #include <cstddef>
@@ -10,7 +11,10 @@
 #include <memory>
 #include <ranges>
 #include <utility>
+#include <vector>
+#include "camera.hpp"
 #include "glm/fwd.hpp"
+#include "profiler.hpp"
 
 auto Renderer::InitInstance() -> bool {
     this->instance = std::make_unique<wgpu::Instance>(wgpu::CreateInstance());
@@ -60,8 +64,22 @@ auto Renderer::InitDevice(const wgpu::Adapter &adapter) -> bool {
         bool requestEnded = false;
     } userData;
 
+    std::vector<wgpu::FeatureName> requiredFeatures;
+    this->gpuTimestampsSupported = this->gpuTimingEnabled && adapter.HasFeature(wgpu::FeatureName::TimestampQuery);
+    if (this->gpuTimestampsSupported) {
+        requiredFeatures.push_back(wgpu::FeatureName::TimestampQuery);
+    } else if (this->gpuTimingEnabled) {
+        std::cerr << "Adapter does not support timestamp queries, GPU timing is disabled" << std::endl;
+    }
+
+    wgpu::DeviceDescriptor deviceDesc{
+        .label = "Renderer",
+        .requiredFeatureCount = requiredFeatures.size(),
+        .requiredFeatures = requiredFeatures.data(),
+    };
+
     adapter.RequestDevice(
-        nullptr,
+        &deviceDesc,
         [](WGPURequestDeviceStatus status, WGPUDevice cDevice, const char *message, void *pUserData) {
             UserData &userData = *static_cast<UserData *>(pUserData);
 
@@ -153,6 +171,8 @@ auto Renderer::InitSurface(const wgpu::Instance &instance, const wgpu::Adapter &
 }
 
 auto Renderer::InitSwapChain(const wgpu::Device &device, const wgpu::Surface &surface, const wgpu::TextureFormat swapChainFormat, const uint32_t width, const uint32_t height) -> bool {
+    this->viewportSize = glm::vec2((float)width, (float)height);
+
     wgpu::SwapChainDescriptor swapChainDesc{
         .label = "Renderer",
         .usage = wgpu::TextureUsage::RenderAttachment,
@@ -172,7 +192,36 @@ auto Renderer::InitSwapChain(const wgpu::Device &device, const wgpu::Surface &su
     return true;
 }
 
+void Renderer::UploadAnimatedScene() {
+    const auto &positions = this->sceneLayout.GetPositions();
+    const auto &scales = this->sceneLayout.GetScales();
+
+    std::vector<AnimatedCubeInstance> instances;
+    instances.reserve(this->sceneLayout.Size());
+    for (size_t i = 0; i < this->sceneLayout.Size(); ++i) {
+        instances.push_back(AnimatedCubeInstance{
+            .position = positions[i],
+            .scale = scales[i],
+            .rotationAxis = glm::vec3(0, 1, 0),
+            .rotationSpeed = glm::radians(60.0f),  // Matches the per-frame CPU path at 60 fps.
+        });
+    }
+
+    this->graphics.SetAnimatedRects(instances);
+}
+
 auto Renderer::Initialize(const uint32_t width, const uint32_t height) -> bool {
+    // 24-bit fixed point depth gains nothing from reverse-Z, the precision win needs the float exponent.
+    this->depthTextureFormat = this->reverseZ ? wgpu::TextureFormat::Depth32Float : wgpu::TextureFormat::Depth24Plus;
+    this->sceneLayout.BuildSphere(this->sceneRadius, this->sceneRingCount, this->sceneMaxPointsInCenterRing, this->sceneCubeScale);
+    if (this->sceneAnimatedOnGpu) {
+        this->UploadAnimatedScene();
+    }
+    this->graphics.SetGpuCulling(this->sceneCulledOnGpu);
+    this->graphics.SetDepthPrePass(this->depthPrePass);
+    this->graphics.SetFrontToBackSorting(this->frontToBackSorting);
+    this->graphics.SetJobSystem(&this->jobSystem);
+
     return this->InitInstance()
         && this->InitAdapter(this->instance->Get())
         && this->InitDevice(this->adapter->Get())
@@ -180,24 +229,128 @@ auto Renderer::Initialize(const uint32_t width, const uint32_t height) -> bool {
         && this->InitSwapChain(this->device->Get(), this->surface->Get(), this->swapChainFormat, width, height)
         && this->InitQueue(this->device->Get())
         && this->InitDepthBuffer(this->device->Get(), width, height)
-        && this->graphics.InitShaders(this->device->Get(), this->swapChainFormat, this->depthTextureFormat, this->queue->Get(), width, height);
+        && this->uploadRing.Init(this->device->Get())
+        && this->uniformArena.Init(this->device->Get())
+        && this->frameGlobals.Init(this->device->Get())
+        && this->graphics.InitShaders(this->device->Get(), this->swapChainFormat, this->depthTextureFormat, this->GetDepthCompare(), this->queue->Get(), this->frameGlobals, this->uniformArena)
+        && (!this->gpuTimestampsSupported || this->gpuTimer.Init(this->device->Get()));
+}
+
+auto Renderer::IsReverseZ() const -> bool {
+    return this->reverseZ;
+}
+
+void Renderer::SetDepthPrePass(const bool enabled) {
+    this->depthPrePass = enabled;
+    this->graphics.SetDepthPrePass(enabled);
+}
+
+auto Renderer::IsDepthPrePassEnabled() const -> bool {
+    return this->depthPrePass;
+}
+
+void Renderer::SetFrontToBackSorting(const bool enabled) {
+    this->frontToBackSorting = enabled;
+    this->graphics.SetFrontToBackSorting(enabled);
+}
+
+auto Renderer::IsFrontToBackSortingEnabled() const -> bool {
+    return this->frontToBackSorting;
+}
+
+auto Renderer::PickInstance(const glm::mat4x4 cameraViewMatrix, const glm::mat4x4 projectionMatrix, const glm::vec2 pointer) -> bool {
+    ProfileScope profileScope("Renderer::PickInstance");
+    this->hasPickedInstance = this->graphics.PickInstance(GetPointerRay(cameraViewMatrix, projectionMatrix, pointer, this->viewportSize), this->pickedInstance);
+    return this->hasPickedInstance;
+}
+
+auto Renderer::GetPickedInstance(SceneInstance &instance) const -> bool {
+    if (this->hasPickedInstance) {
+        instance = this->pickedInstance;
+    }
+    return this->hasPickedInstance;
+}
+
+void Renderer::DrawPickedInstance() {
+    glm::vec4 sphere;
+    if (!this->hasPickedInstance || !this->graphics.GetInstanceSphere(this->pickedInstance, sphere)) {
+        return;
+    }
+
+    // The box the pick tests against, the twelve edges as four parallel to each axis.
+    const glm::vec3 boundsMin = glm::vec3(sphere) - glm::vec3(sphere.w);
+    const glm::vec3 boundsMax = glm::vec3(sphere) + glm::vec3(sphere.w);
+    for (int axis = 0; axis < 3; ++axis) {
+        const int u = (axis + 1) % 3;
+        const int v = (axis + 2) % 3;
+        for (int corner = 0; corner < 4; ++corner) {
+            glm::vec3 start = boundsMin;
+            start[u] = (corner & 1) != 0 ? boundsMax[u] : boundsMin[u];
+            start[v] = (corner & 2) != 0 ? boundsMax[v] : boundsMin[v];
+            glm::vec3 end = start;
+            end[axis] = boundsMax[axis];
+            this->graphics.DrawLine(start, end, glm::vec3(1.0f, 0.8f, 0.0f), 2.0f);
+        }
+    }
+}
+
+auto Renderer::GetDepthCompare() const -> wgpu::CompareFunction {
+    return this->reverseZ ? wgpu::CompareFunction::Greater : wgpu::CompareFunction::Less;
 }
 
 void Renderer::Resize(const uint32_t width, const uint32_t height) {
     this->InitSwapChain(this->device->Get(), this->surface->Get(), this->swapChainFormat, width, height);
     this->InitDepthBuffer(this->device->Get(), width, height);
-    this->graphics.Resize(width, height);
+}
+
+void Renderer::SetSceneParameters(const float radius, const int numRings, const int maxPointsInCenterRing) {
+    if (radius == this->sceneRadius && numRings == this->sceneRingCount && maxPointsInCenterRing == this->sceneMaxPointsInCenterRing) {
+        return;
+    }
+
+    this->sceneRadius = radius;
+    this->sceneRingCount = numRings;
+    this->sceneMaxPointsInCenterRing = maxPointsInCenterRing;
+    this->sceneLayout.BuildSphere(this->sceneRadius, this->sceneRingCount, this->sceneMaxPointsInCenterRing, this->sceneCubeScale);
+    if (this->sceneAnimatedOnGpu) {
+        this->UploadAnimatedScene();
+    }
 }
 
 void Renderer::Render(const glm::mat4x4 cameraViewMatrix, const glm::mat4x4 projectionMatrix, const float time) {
+    ProfileScope profileScope("Renderer::Render");
+
     wgpu::TextureView nextTexture = this->swapChain->GetCurrentTextureView();
     if (!nextTexture) {
         std::cerr << "Failed to get nextTexture." << std::endl;
         return;
     }
 
+    this->gpuTimer.BeginFrame();
+
+    if (!this->sceneAnimatedOnGpu) {
+        ProfileScope generateScope("Renderer::GenerateInstances");
+        this->angle++;
+
+        // Only the rotation is animated, the cached layout supplies translation and scale.
+        const glm::quat rotation = glm::angleAxis(glm::radians(this->angle), glm::vec3(0, 1, 0));  // rotation y
+        this->graphics.DrawRects(this->sceneLayout.GetPositions(), this->sceneLayout.GetScales(), rotation);
+    }
+
+    this->DrawPickedInstance();
+
+    // The only view-projection product of the frame, shaders and culling all take it from here.
+    const glm::mat4x4 viewProjectionMatrix = projectionMatrix * cameraViewMatrix;
+    this->frameGlobals.Update(this->uploadRing, cameraViewMatrix, projectionMatrix, viewProjectionMatrix, time, this->viewportSize);
+    this->graphics.Update(this->uploadRing, this->queue->Get(), viewProjectionMatrix, GetScreenScale(projectionMatrix, this->viewportSize.y));
+    this->uniformArena.Flush(this->uploadRing);
+
     wgpu::CommandEncoder encoder = this->device->CreateCommandEncoder();
 
+    // The copies have to be encoded ahead of the passes reading them.
+    this->uploadRing.Flush(encoder, this->queue->Get());
+    this->graphics.Prepare(encoder, this->gpuTimer.GetComputePassTimestampWrites("GPU::CullPass"));
+
     {  // Render pass
         wgpu::RenderPassColorAttachment renderPassColorAttachment{
             .view = nextTexture,
@@ -209,7 +362,7 @@ void Renderer::Render(const glm::mat4x4 cameraViewMatrix, const glm::mat4x4 proj
             .view = this->depthTextureView->Get(),
             .depthLoadOp = wgpu::LoadOp::Clear,
             .depthStoreOp = wgpu::StoreOp::Store,
-            .depthClearValue = 1.0f,
+            .depthClearValue = this->reverseZ ? 0.0f : 1.0f,  // The farthest depth
             .depthReadOnly = false,
             // Stencil is not used
             .stencilLoadOp = wgpu::LoadOp::Undefined,
@@ -222,49 +375,21 @@ void Renderer::Render(const glm::mat4x4 cameraViewMatrix, const glm::mat4x4 proj
             .colorAttachmentCount = 1,
             .colorAttachments = &renderPassColorAttachment,
             .depthStencilAttachment = &renderPassDepthStencilAttachment,
-            .timestampWrites = nullptr,
+            .timestampWrites = this->gpuTimer.GetRenderPassTimestampWrites("GPU::RenderPass"),
         };
 
         auto renderPass = encoder.BeginRenderPass(&renderPassDesc);
-
-        this->angle++;
-
-        float radius = 200.0;
-        int num_rings = 20;
-        int max_points_in_center_ring = 30;
-
-        for (int i = 0; i < num_rings; ++i) {
-            // Calculate the latitude angle theta (from 0 to pi)
-            double theta = M_PI * (i + 0.5) / num_rings;
-
-            // Number of points on this ring
-            int num_points = static_cast<int>(max_points_in_center_ring * std::sin(theta));
-
-            for (int j = 0; j < num_points; ++j) {
-                // Calculate the longitude angle phi (from 0 to 2*pi)
-                double phi = 2 * M_PI * j / num_points;
-
-                // Convert spherical coordinates to Cartesian coordinates
-                double x = std::sin(theta) * std::cos(phi) * radius;
-                double y = std::sin(theta) * std::sin(phi) * radius;
-                double z = std::cos(theta) * radius;
-
-                auto transform = glm::mat4x4(1.0f);
-                transform = glm::translate(transform, glm::vec3(x, y, z));  // position
-                // transform = glm::rotate(transform, glm::radians(this->angle), glm::vec3(1, 0, 0));  // rotation x
-                transform = glm::rotate(transform, glm::radians(this->angle), glm::vec3(0, 1, 0));  // rotation y
-                // transform = glm::rotate(transform, glm::radians(this->angle), glm::vec3(0, 0, 1));  // rotation z
-                transform = glm::scale(transform, glm::vec3(5.0f, 5.0f, 5.0f));  // scale
-
-                this->graphics.DrawRect(transform);
-            }
-        }
-
-        this->graphics.Render(renderPass, this->queue->Get(), cameraViewMatrix, projectionMatrix, time);
+        this->frameGlobals.Bind(renderPass);
+        this->graphics.Render(renderPass);
 
         renderPass.End();
     }
 
+    this->gpuTimer.Resolve(encoder);
+
+    ProfileScope submitScope("Renderer::Submit");
     wgpu::CommandBuffer command = encoder.Finish();
     this->queue->Submit(1, &command);
+
+    this->gpuTimer.EndFrame();
 }
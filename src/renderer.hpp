@@ -2,7 +2,13 @@
 #include <webgpu/webgpu_cpp.h>
 #include <glm/glm.hpp>
 #include <memory>
+#include "frameGlobals.hpp"
+#include "gpuTimer.hpp"
 #include "graphics.hpp"
+#include "jobSystem.hpp"
+#include "sceneLayout.hpp"
+#include "uniformArena.hpp"
+#include "uploadRing.hpp"
 
 class Renderer {
    private:
@@ -12,15 +18,45 @@ class Renderer {
     std::unique_ptr<wgpu::Queue> queue;
     std::unique_ptr<wgpu::Surface> surface;
     wgpu::TextureFormat swapChainFormat = wgpu::TextureFormat::Undefined;
-    wgpu::TextureFormat depthTextureFormat = wgpu::TextureFormat::Depth24Plus;
+    // Reverse-Z pairs a float depth buffer with Camera::SetReverseZ, the camera has to match IsReverseZ.
+    bool reverseZ = true;
+    wgpu::TextureFormat depthTextureFormat = wgpu::TextureFormat::Undefined;
     std::unique_ptr<wgpu::Texture> depthTexture;
     std::unique_ptr<wgpu::TextureView> depthTextureView;
     std::unique_ptr<wgpu::SwapChain> swapChain;
+    glm::vec2 viewportSize{1.0f, 1.0f};
 
-    Graphics graphics;
+    // Inline unless built with ENABLE_THREADS, see JobSystem::DefaultWorkerCount.
+    JobSystem jobSystem{JobSystem::DefaultWorkerCount()};
+    Graphics graphics{CubeInstanceFormat::Compact};
+    // Every per-frame upload goes through here, sent with one WriteBuffer before the passes.
+    UploadRing uploadRing{1 << 20};
+    UniformArena uniformArena{1 << 16};
+    FrameGlobals frameGlobals;
+    SceneLayout sceneLayout;
+
+    float sceneRadius = 200.0f;
+    int sceneRingCount = 20;
+    int sceneMaxPointsInCenterRing = 30;
+    float sceneCubeScale = 5.0f;
+    // Upload the layout once and rotate the cubes in the vertex shader instead of re-uploading matrices every frame.
+    bool sceneAnimatedOnGpu = true;
+    // Cull the animated cubes in a compute pass, so the main thread never touches them per frame.
+    bool sceneCulledOnGpu = true;
+    // Runtime toggles for comparing fragment load, off until shading is expensive enough to need them.
+    bool depthPrePass = false;
+    bool frontToBackSorting = false;
+    // Last successful pick, outlined every frame until the next pick misses.
+    bool hasPickedInstance = false;
+    SceneInstance pickedInstance = SceneInstance();
 
     float angle = 0;
 
+    // Opt-in, records pass durations into the Profiler when the adapter supports timestamp queries.
+    bool gpuTimingEnabled = false;
+    bool gpuTimestampsSupported = false;
+    GpuTimer gpuTimer;
+
    public:
     Renderer() = default;
     ~Renderer() = default;
@@ -31,7 +67,19 @@ class Renderer {
 
     auto Initialize(const uint32_t width, const uint32_t height) -> bool;
     void Resize(const uint32_t width, const uint32_t height);
+    void SetSceneParameters(const float radius, const int numRings, const int maxPointsInCenterRing);
     void Render(const glm::mat4x4 cameraViewMatrix, const glm::mat4x4 projectionMatrix, const float time);
+    auto IsReverseZ() const -> bool;
+    void SetDepthPrePass(const bool enabled);
+    auto IsDepthPrePassEnabled() const -> bool;
+    void SetFrontToBackSorting(const bool enabled);
+    auto IsFrontToBackSortingEnabled() const -> bool;
+    // Selects the retained instance under pointer, in pixels from the top left of the viewport, and outlines it.
+    // Returns false and clears the selection when there is none.
+    // Only the GPU-animated scene is retained, the per-frame cubes drawn without sceneAnimatedOnGpu are not pickable.
+    auto PickInstance(const glm::mat4x4 cameraViewMatrix, const glm::mat4x4 projectionMatrix, const glm::vec2 pointer) -> bool;
+    // The selection made by PickInstance, false when there is none.
+    auto GetPickedInstance(SceneInstance &instance) const -> bool;
 
    private:
     auto InitInstance() -> bool;
@@ -40,5 +88,8 @@ class Renderer {
     auto InitSurface(const wgpu::Instance& instance, const wgpu::Adapter& adapter) -> bool;
     auto InitQueue(const wgpu::Device& device) -> bool;
     auto InitDepthBuffer(const wgpu::Device& device, const uint32_t width, const uint32_t height) -> bool;
+    void UploadAnimatedScene();
+    void DrawPickedInstance();
+    auto GetDepthCompare() const -> wgpu::CompareFunction;
     auto InitSwapChain(const wgpu::Device& device, const wgpu::Surface& surface, const wgpu::TextureFormat swapChainFormat, const uint32_t width, const uint32_t height) -> bool;
 };
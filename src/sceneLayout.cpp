@@ -0,0 +1,40 @@
+#include "sceneLayout.hpp"
+#include <cmath>
+
+void SceneLayout::BuildSphere(const float radius, const int numRings, const int maxPointsInCenterRing, const float instanceScale) {
+    this->positions.clear();
+    this->scales.clear();
+
+    for (int i = 0; i < numRings; ++i) {
+        // Calculate the latitude angle theta (from 0 to pi)
+        double theta = M_PI * (i + 0.5) / numRings;
+
+        // Number of points on this ring
+        int num_points = static_cast<int>(maxPointsInCenterRing * std::sin(theta));
+
+        for (int j = 0; j < num_points; ++j) {
+            // Calculate the longitude angle phi (from 0 to 2*pi)
+            double phi = 2 * M_PI * j / num_points;
+
+            // Convert spherical coordinates to Cartesian coordinates
+            double x = std::sin(theta) * std::cos(phi) * radius;
+            double y = std::sin(theta) * std::sin(phi) * radius;
+            double z = std::cos(theta) * radius;
+
+            this->positions.emplace_back(x, y, z);
+            this->scales.push_back(instanceScale);
+        }
+    }
+}
+
+auto SceneLayout::Size() const -> size_t {
+    return this->positions.size();
+}
+
+auto SceneLayout::GetPositions() const -> const std::vector<glm::vec3> & {
+    return this->positions;
+}
+
+auto SceneLayout::GetScales() const -> const std::vector<float> & {
+    return this->scales;
+}
@@ -0,0 +1,24 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <vector>
+
+// Static per-instance placement, kept as structure-of-arrays so it only has to be built once.
+class SceneLayout {
+   public:
+    SceneLayout() = default;
+    ~SceneLayout() = default;
+    SceneLayout(const SceneLayout &) = delete;
+    SceneLayout(SceneLayout &&) = delete;
+    auto operator=(const SceneLayout &) -> SceneLayout & = delete;
+    auto operator=(SceneLayout &&) -> SceneLayout & = delete;
+
+    void BuildSphere(const float radius, const int numRings, const int maxPointsInCenterRing, const float instanceScale);
+    auto Size() const -> size_t;
+    auto GetPositions() const -> const std::vector<glm::vec3> &;
+    auto GetScales() const -> const std::vector<float> &;
+
+   private:
+    std::vector<glm::vec3> positions;
+    std::vector<float> scales;
+};
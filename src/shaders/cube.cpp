@@ -1,6 +1,10 @@
 #include "cube.hpp"
+#include <algorithm>
 #include <cstddef>
+#include <tuple>
 #include <vector>
+#include "../frustum.hpp"
+#include "../profiler.hpp"
 #include "../resourceManager.hpp"
 #include "glm/ext/matrix_clip_space.hpp"
 #include "glm/ext/matrix_transform.hpp"
@@ -12,33 +16,53 @@ constexpr auto offsetOfMember(U T::*member) -> size_t {
     return (char *)&((T *)nullptr->*member) - (char *)nullptr;
 }
 
-struct VertexAttributes {
-    glm::vec3 position;
-    glm::vec3 color;
+constexpr uint32_t cullWorkgroupSize = 64;  // Should be the same as @workgroup_size in cube_cull.wgsl.
+
+// Arguments read by DrawIndexedIndirect, should be the same as in cube_cull.wgsl.
+struct DrawIndexedIndirectArgs {
+    uint32_t indexCount;
+    uint32_t instanceCount;
+    uint32_t firstIndex;
+    int32_t baseVertex;
+    uint32_t firstInstance;
 };
 
-CubeShader::CubeShader(size_t maxCubeCount) : maxCubeCount(maxCubeCount) {
+CubeShader::CubeShader(size_t initialCubeCount, CubeInstanceFormat instanceFormat) : initialCubeCount(initialCubeCount), instanceFormat(instanceFormat) {
+}
+
+auto CubeShader::GetInstanceFormat() const -> CubeInstanceFormat {
+    return this->instanceFormat;
+}
+
+auto CubeShader::GetInstanceStride() const -> uint64_t {
+    return GetCubeInstanceStride(this->instanceFormat);
 }
 
-auto CubeShader::InitRenderPipeline(const wgpu::Device &device, const wgpu::TextureFormat swapChainFormat, const wgpu::TextureFormat depthTextureFormat) -> bool {
+auto CubeShader::InitRenderPipeline(const wgpu::Device &device, const wgpu::TextureFormat swapChainFormat, const wgpu::TextureFormat depthTextureFormat, const wgpu::CompareFunction depthCompare, const wgpu::BindGroupLayout &frameBindGroupLayout) -> bool {
     this->shaderModule = ResourceManager::LoadShaderModule("/src/shaders/cube.wgsl", device);
 
-    std::array<wgpu::VertexAttribute, 2> vertexAttribs{
-        // VertexAttributes::positiom
+    std::array<wgpu::VertexAttribute, 3> vertexAttribs{
+        // MeshVertex::position
         wgpu::VertexAttribute{
             .format = wgpu::VertexFormat::Float32x3,
-            .offset = offsetOfMember(&VertexAttributes::position),
+            .offset = offsetOfMember(&MeshVertex::position),
             .shaderLocation = 0,
         },
-        // VertexAttributes::color
+        // MeshVertex::color
         wgpu::VertexAttribute{
             .format = wgpu::VertexFormat::Float32x3,
-            .offset = offsetOfMember(&VertexAttributes::color),
+            .offset = offsetOfMember(&MeshVertex::color),
             .shaderLocation = 1,
         },
+        // MeshVertex::normal, after the instance attributes
+        wgpu::VertexAttribute{
+            .format = wgpu::VertexFormat::Float32x3,
+            .offset = offsetOfMember(&MeshVertex::normal),
+            .shaderLocation = 6,
+        },
     };
     wgpu::VertexBufferLayout vertexBufferLayout{
-        .arrayStride = sizeof(VertexAttributes),
+        .arrayStride = sizeof(MeshVertex),
         .stepMode = wgpu::VertexStepMode::Vertex,
         .attributeCount = (uint32_t)vertexAttribs.size(),
         .attributes = vertexAttribs.data(),
@@ -61,6 +85,60 @@ auto CubeShader::InitRenderPipeline(const wgpu::Device &device, const wgpu::Text
         .attributes = instanceAttribs.data(),
     };
 
+    // CompactCubeInstance, unpacked in vs_compact
+    std::array<wgpu::VertexAttribute, 2> compactInstanceAttribs{
+        // CompactCubeInstance::translation & CompactCubeInstance::scale
+        wgpu::VertexAttribute{
+            .format = wgpu::VertexFormat::Float32x4,
+            .offset = offsetOfMember(&CompactCubeInstance::translation),
+            .shaderLocation = 2,
+        },
+        // CompactCubeInstance::rotation
+        wgpu::VertexAttribute{
+            .format = wgpu::VertexFormat::Snorm16x4,
+            .offset = offsetOfMember(&CompactCubeInstance::rotation),
+            .shaderLocation = 3,
+        },
+    };
+    wgpu::VertexBufferLayout compactInstanceBufferLayout{
+        .arrayStride = sizeof(CompactCubeInstance),
+        .stepMode = wgpu::VertexStepMode::Instance,
+        .attributeCount = (uint32_t)compactInstanceAttribs.size(),
+        .attributes = compactInstanceAttribs.data(),
+    };
+    const bool isCompact = this->instanceFormat == CubeInstanceFormat::Compact;
+    auto bufferLayouts = std::array{vertexBufferLayout, isCompact ? compactInstanceBufferLayout : instanceBufferLayout};
+
+    // AnimatedCubeInstance, uploaded once and animated in vs_animated
+    std::array<wgpu::VertexAttribute, 4> animatedInstanceAttribs{
+        wgpu::VertexAttribute{
+            .format = wgpu::VertexFormat::Float32x3,
+            .offset = offsetOfMember(&AnimatedCubeInstance::position),
+            .shaderLocation = 2,
+        },
+        wgpu::VertexAttribute{
+            .format = wgpu::VertexFormat::Float32,
+            .offset = offsetOfMember(&AnimatedCubeInstance::scale),
+            .shaderLocation = 3,
+        },
+        wgpu::VertexAttribute{
+            .format = wgpu::VertexFormat::Float32x3,
+            .offset = offsetOfMember(&AnimatedCubeInstance::rotationAxis),
+            .shaderLocation = 4,
+        },
+        wgpu::VertexAttribute{
+            .format = wgpu::VertexFormat::Float32,
+            .offset = offsetOfMember(&AnimatedCubeInstance::rotationSpeed),
+            .shaderLocation = 5,
+        },
+    };
+    wgpu::VertexBufferLayout animatedInstanceBufferLayout{
+        .arrayStride = sizeof(AnimatedCubeInstance),
+        .stepMode = wgpu::VertexStepMode::Instance,
+        .attributeCount = (uint32_t)animatedInstanceAttribs.size(),
+        .attributes = animatedInstanceAttribs.data(),
+    };
+
     wgpu::BlendState blendState{
         .color = wgpu::BlendComponent{
             .operation = wgpu::BlendOperation::Add,
@@ -91,7 +169,7 @@ auto CubeShader::InitRenderPipeline(const wgpu::Device &device, const wgpu::Text
     wgpu::DepthStencilState depthStencilState = {
         .format = depthTextureFormat,
         .depthWriteEnabled = true,
-        .depthCompare = wgpu::CompareFunction::Less,
+        .depthCompare = depthCompare,
         .stencilReadMask = 0,
         .stencilWriteMask = 0,
     };
@@ -100,17 +178,17 @@ auto CubeShader::InitRenderPipeline(const wgpu::Device &device, const wgpu::Text
         .label = "cube",
         .vertex = wgpu::VertexState{
             .module = this->shaderModule->Get(),
-            .entryPoint = "vs_main",
+            .entryPoint = isCompact ? "vs_compact" : "vs_main",
             .constantCount = 0,
             .constants = nullptr,
             .bufferCount = 2,
-            .buffers = std::array{vertexBufferLayout, instanceBufferLayout}.data(),
+            .buffers = bufferLayouts.data(),
         },
         .primitive = wgpu::PrimitiveState{
-            .topology = wgpu::PrimitiveTopology::TriangleStrip,
+            .topology = wgpu::PrimitiveTopology::TriangleList,
             .stripIndexFormat = wgpu::IndexFormat::Undefined,
             .frontFace = wgpu::FrontFace::CCW,
-            .cullMode = wgpu::CullMode::None,
+            .cullMode = wgpu::CullMode::Back,  // Meshes are closed and opaque
         },
         .depthStencil = &depthStencilState,
         .multisample = wgpu::MultisampleState{
@@ -124,147 +202,474 @@ auto CubeShader::InitRenderPipeline(const wgpu::Device &device, const wgpu::Text
     wgpu::PipelineLayoutDescriptor layoutDesc{
         .label = "cube pipeline layout",
         .bindGroupLayoutCount = 1,
-        .bindGroupLayouts = this->bindGroupLayout.get(),
+        .bindGroupLayouts = &frameBindGroupLayout,
     };
 
     pipelineDesc.layout = device.CreatePipelineLayout(&layoutDesc);
 
-    this->pipeline = std::make_unique<wgpu::RenderPipeline>(device.CreateRenderPipeline(&pipelineDesc));
+    // MeshMaterial order.
+    const std::array<const char *, meshMaterialCount> vertexEntryPoints{
+        isCompact ? "vs_compact" : "vs_main",
+        isCompact ? "vs_compact" : "vs_main",
+        isCompact ? "vs_compact_impostor" : "vs_impostor",
+    };
+    constexpr std::array<const char *, meshMaterialCount> fragmentEntryPoints{"fs_main", "fs_unlit", "fs_main"};
+    auto animatedBuffers = std::array{vertexBufferLayout, animatedInstanceBufferLayout};
+
+    auto createPipelineSet = [&](PipelineSet &pipelineSet, const char *label, const char *animatedLabel, const bool depthOnly) {
+        pipelineDesc.label = label;
+        pipelineDesc.vertex.buffers = bufferLayouts.data();
+        for (size_t material = 0; material < meshMaterialCount; ++material) {
+            pipelineDesc.vertex.entryPoint = vertexEntryPoints[material];
+            fragmentState.entryPoint = depthOnly ? "fs_unlit" : fragmentEntryPoints[material];
+            pipelineSet.materials[material] = std::make_unique<wgpu::RenderPipeline>(device.CreateRenderPipeline(&pipelineDesc));
+        }
+
+        // Same pipeline, but the model matrix is built in the shader from the static instance data.
+        pipelineDesc.label = animatedLabel;
+        pipelineDesc.vertex.entryPoint = "vs_animated";
+        pipelineDesc.vertex.buffers = animatedBuffers.data();
+        fragmentState.entryPoint = depthOnly ? "fs_unlit" : fragmentEntryPoints[(size_t)MeshMaterial::Lit];
+        pipelineSet.animated = std::make_unique<wgpu::RenderPipeline>(device.CreateRenderPipeline(&pipelineDesc));
+
+        return std::all_of(pipelineSet.materials.begin(), pipelineSet.materials.end(), [](const auto &pipeline) { return pipeline != nullptr; })
+            && pipelineSet.animated != nullptr;
+    };
+
+    const bool created = createPipelineSet(this->pipelines, "cube", "cube animated", false);
+
+    // The pre-pass runs the same vertex shaders, whose position is @invariant, so the color pass
+    // reproduces its depth exactly and can test OrEqual without writing.
+    depthStencilState.depthCompare = depthCompare == wgpu::CompareFunction::Greater ? wgpu::CompareFunction::GreaterEqual : wgpu::CompareFunction::LessEqual;
+    depthStencilState.depthWriteEnabled = false;
+    const bool createdAfterPrePass = createPipelineSet(this->afterPrePassPipelines, "cube after pre-pass", "cube animated after pre-pass", false);
+
+    // Pipelines without a fragment stage do not match a pass with a color attachment,
+    // so the pre-pass keeps the cheapest one and masks its writes.
+    depthStencilState.depthCompare = depthCompare;
+    depthStencilState.depthWriteEnabled = true;
+    colorTarget.blend = nullptr;
+    colorTarget.writeMask = wgpu::ColorWriteMask::None;
+    const bool createdDepth = createPipelineSet(this->depthPipelines, "cube depth", "cube animated depth", true);
 
-    return this->pipeline != nullptr;
+    return created && createdAfterPrePass && createdDepth;
 }
 
-auto CubeShader::InitUniforms(const wgpu::Device &device) -> bool {
-    wgpu::BufferDescriptor bufferDesc{
-        .label = "cube",
-        .usage = wgpu::BufferUsage::CopyDst | wgpu::BufferUsage::Uniform,
-        .size = sizeof(MyUniforms),
-        .mappedAtCreation = false,
-    };
-    this->uniformBuffer = std::make_unique<wgpu::Buffer>(device.CreateBuffer(&bufferDesc));
+auto CubeShader::InitInstanceBuffer(const wgpu::Device &device) -> bool {
+    this->instanceBuffer = std::make_unique<DynamicBuffer>("cube_instance_buffer", wgpu::BufferUsage::Vertex, (uint64_t)this->initialCubeCount * this->GetInstanceStride());
+    // Only rewritten when the animated instances change, no need for a ring.
+    this->animatedInstanceBuffer = std::make_unique<DynamicBuffer>("cube_animated_instance_buffer", wgpu::BufferUsage::Vertex | wgpu::BufferUsage::Storage, (uint64_t)this->initialCubeCount * sizeof(AnimatedCubeInstance), 1);
 
-    return this->uniformBuffer != nullptr;
+    return this->instanceBuffer->Init(device)
+        && this->animatedInstanceBuffer->Init(device);
 }
 
-auto CubeShader::InitBindGroupLayout(const wgpu::Device &device) -> bool {
-    std::array<wgpu::BindGroupLayoutEntry, 1> bindingLayoutEntries{
+auto CubeShader::InitCullPipeline(const wgpu::Device &device) -> bool {
+    this->cullShaderModule = ResourceManager::LoadShaderModule("/src/shaders/cube_cull.wgsl", device);
+
+    std::array<wgpu::BindGroupLayoutEntry, 4> bindingLayoutEntries{
+        // CubeCullUniforms
         wgpu::BindGroupLayoutEntry{
             .binding = 0,
-            .visibility = wgpu::ShaderStage::Vertex | wgpu::ShaderStage::Fragment,
+            .visibility = wgpu::ShaderStage::Compute,
             .buffer = wgpu::BufferBindingLayout{
                 .type = wgpu::BufferBindingType::Uniform,
-                .hasDynamicOffset = true,
-                .minBindingSize = sizeof(MyUniforms),
+                .minBindingSize = sizeof(CubeCullUniforms),
+            },
+        },
+        // All animated instances
+        wgpu::BindGroupLayoutEntry{
+            .binding = 1,
+            .visibility = wgpu::ShaderStage::Compute,
+            .buffer = wgpu::BufferBindingLayout{
+                .type = wgpu::BufferBindingType::ReadOnlyStorage,
+            },
+        },
+        // Visible animated instances
+        wgpu::BindGroupLayoutEntry{
+            .binding = 2,
+            .visibility = wgpu::ShaderStage::Compute,
+            .buffer = wgpu::BufferBindingLayout{
+                .type = wgpu::BufferBindingType::Storage,
+            },
+        },
+        // DrawIndirect arguments
+        wgpu::BindGroupLayoutEntry{
+            .binding = 3,
+            .visibility = wgpu::ShaderStage::Compute,
+            .buffer = wgpu::BufferBindingLayout{
+                .type = wgpu::BufferBindingType::Storage,
+                .minBindingSize = sizeof(DrawIndexedIndirectArgs),
             },
         },
     };
 
     wgpu::BindGroupLayoutDescriptor bindGroupLayoutDesc{
-        .label = "cube",
+        .label = "cube cull",
         .entryCount = (uint32_t)bindingLayoutEntries.size(),
         .entries = bindingLayoutEntries.data(),
     };
-    this->bindGroupLayout = std::make_unique<wgpu::BindGroupLayout>(device.CreateBindGroupLayout(&bindGroupLayoutDesc));
+    this->cullBindGroupLayout = std::make_unique<wgpu::BindGroupLayout>(device.CreateBindGroupLayout(&bindGroupLayoutDesc));
+
+    wgpu::PipelineLayoutDescriptor layoutDesc{
+        .label = "cube cull pipeline layout",
+        .bindGroupLayoutCount = 1,
+        .bindGroupLayouts = this->cullBindGroupLayout.get(),
+    };
+
+    wgpu::ComputePipelineDescriptor pipelineDesc{
+        .label = "cube cull",
+        .layout = device.CreatePipelineLayout(&layoutDesc),
+        .compute = wgpu::ProgrammableStageDescriptor{
+            .module = this->cullShaderModule->Get(),
+            .entryPoint = "cs_main",
+            .constantCount = 0,
+            .constants = nullptr,
+        },
+    };
+    this->cullPipeline = std::make_unique<wgpu::ComputePipeline>(device.CreateComputePipeline(&pipelineDesc));
+
+    return this->cullPipeline != nullptr;
+}
+
+auto CubeShader::InitCullBuffers(const wgpu::Device &device) -> bool {
+    wgpu::BufferDescriptor uniformBufferDesc{
+        .label = "cube cull",
+        .usage = wgpu::BufferUsage::CopyDst | wgpu::BufferUsage::Uniform,
+        .size = sizeof(CubeCullUniforms),
+        .mappedAtCreation = false,
+    };
+    this->cullUniformBuffer = std::make_unique<wgpu::Buffer>(device.CreateBuffer(&uniformBufferDesc));
+
+    wgpu::BufferDescriptor indirectBufferDesc{
+        .label = "cube_indirect_buffer",
+        .usage = wgpu::BufferUsage::CopyDst | wgpu::BufferUsage::Storage | wgpu::BufferUsage::Indirect,
+        .size = sizeof(DrawIndexedIndirectArgs),
+        .mappedAtCreation = false,
+    };
+    this->indirectBuffer = std::make_unique<wgpu::Buffer>(device.CreateBuffer(&indirectBufferDesc));
+
+    // Written only by the compute pass, which finishes before the render pass reads it.
+    this->culledInstanceBuffer = std::make_unique<DynamicBuffer>("cube_culled_instance_buffer", wgpu::BufferUsage::Vertex | wgpu::BufferUsage::Storage, (uint64_t)this->initialCubeCount * sizeof(AnimatedCubeInstance), 1);
 
-    return this->bindGroupLayout != nullptr;
+    return this->cullUniformBuffer != nullptr
+        && this->indirectBuffer != nullptr
+        && this->culledInstanceBuffer->Init(device)
+        && this->InitCullBindGroup(device);
 }
 
-auto CubeShader::InitBindGroup(const wgpu::Device &device, const wgpu::Buffer &uniformBuffer, const wgpu::BindGroupLayout &bindGroupLayout) -> bool {
-    std::array<wgpu::BindGroupEntry, 1> bindings = {
+auto CubeShader::InitCullBindGroup(const wgpu::Device &device) -> bool {
+    std::array<wgpu::BindGroupEntry, 4> bindings = {
         wgpu::BindGroupEntry{
             .binding = 0,
-            .buffer = uniformBuffer.Get(),
+            .buffer = this->cullUniformBuffer->Get(),
+            .offset = 0,
+            .size = sizeof(CubeCullUniforms),
+        },
+        wgpu::BindGroupEntry{
+            .binding = 1,
+            .buffer = this->animatedInstanceBuffer->Get(),
+            .offset = 0,
+            .size = this->animatedInstanceBuffer->GetCapacity(),
+        },
+        wgpu::BindGroupEntry{
+            .binding = 2,
+            .buffer = this->culledInstanceBuffer->Get(),
+            .offset = 0,
+            .size = this->culledInstanceBuffer->GetCapacity(),
+        },
+        wgpu::BindGroupEntry{
+            .binding = 3,
+            .buffer = this->indirectBuffer->Get(),
             .offset = 0,
-            .size = sizeof(MyUniforms),
+            .size = sizeof(DrawIndexedIndirectArgs),
         },
     };
 
     wgpu::BindGroupDescriptor bindGroupDesc = {
-        .label = "cube uniform bind group",
-        .layout = bindGroupLayout.Get(),
+        .label = "cube cull bind group",
+        .layout = this->cullBindGroupLayout->Get(),
         .entryCount = (uint32_t)bindings.size(),
         .entries = bindings.data(),
     };
-    this->bindGroup = std::make_unique<wgpu::BindGroup>(device.CreateBindGroup(&bindGroupDesc));
+    this->cullBindGroup = std::make_unique<wgpu::BindGroup>(device.CreateBindGroup(&bindGroupDesc));
 
-    return this->bindGroup != nullptr;
+    return this->cullBindGroup != nullptr;
 }
 
-auto CubeShader::InitVertexBuffer(const wgpu::Device &device, const wgpu::Queue &queue) -> bool {
-    std::vector<VertexAttributes> quadVertices = {
-        VertexAttributes{.position = glm::vec3(-1.0f, 1.0f, 1.0f), .color = glm::vec3(1.0f, 0.0f, 0.0f)},    // Front-top-left
-        VertexAttributes{.position = glm::vec3(1.0f, 1.0f, 1.0f), .color = glm::vec3(0.0f, 1.0f, 0.0f)},     // Front-top-right
-        VertexAttributes{.position = glm::vec3(-1.0f, -1.0f, 1.0f), .color = glm::vec3(0.0f, 0.0f, 1.0f)},   // Front-bottom-left
-        VertexAttributes{.position = glm::vec3(1.0f, -1.0f, 1.0f), .color = glm::vec3(1.0f, 0.0f, 1.0f)},    // Front-bottom-right
-        VertexAttributes{.position = glm::vec3(1.0f, -1.0f, -1.0f), .color = glm::vec3(1.0f, 1.0f, 0.0f)},   // Back-bottom-right
-        VertexAttributes{.position = glm::vec3(1.0f, 1.0f, 1.0f), .color = glm::vec3(0.0f, 1.0f, 0.0f)},     // Front-top-right
-        VertexAttributes{.position = glm::vec3(1.0f, 1.0f, -1.0f), .color = glm::vec3(1.0f, 0.0f, 1.0f)},    // Back-top-right
-        VertexAttributes{.position = glm::vec3(-1.0f, 1.0f, 1.0f), .color = glm::vec3(1.0f, 0.0f, 0.0f)},    // Front-top-left
-        VertexAttributes{.position = glm::vec3(-1.0f, 1.0f, -1.0f), .color = glm::vec3(1.0f, 0.0f, 1.0f)},   // Back-top-left
-        VertexAttributes{.position = glm::vec3(-1.0f, -1.0f, 1.0f), .color = glm::vec3(0.0f, 0.0f, 1.0f)},   // Front-bottom-left
-        VertexAttributes{.position = glm::vec3(-1.0f, -1.0f, -1.0f), .color = glm::vec3(0.5f, 0.5f, 0.5f)},  // Back-bottom-left
-        VertexAttributes{.position = glm::vec3(1.0f, -1.0f, -1.0f), .color = glm::vec3(1.0f, 1.0f, 0.0f)},   // Back-bottom-right
-        VertexAttributes{.position = glm::vec3(-1.0f, 1.0f, -1.0f), .color = glm::vec3(1.0f, 0.0f, 1.0f)},   // Back-top-left
-        VertexAttributes{.position = glm::vec3(1.0f, 1.0f, -1.0f), .color = glm::vec3(1.0f, 0.0f, 1.0f)},    // Back-top-right
-    };
+auto CubeShader::Init(const wgpu::Device &device, const wgpu::TextureFormat swapChainFormat, const wgpu::TextureFormat depthTextureFormat, const wgpu::CompareFunction depthCompare, const FrameGlobals &frameGlobals, const MeshRegistry &meshRegistry, const MeshId animatedMesh) -> bool {
+    this->device = device;
+    this->frameBindGroup = frameGlobals.GetBindGroup();
+    this->swapChainFormat = swapChainFormat;
+    this->depthTextureFormat = depthTextureFormat;
+    this->staticBundleDirty = true;
+    this->meshRegistry = &meshRegistry;
+    this->animatedMesh = animatedMesh;
+
+    return this->InitRenderPipeline(device, swapChainFormat, depthTextureFormat, depthCompare, frameGlobals.GetBindGroupLayout())
+        && this->InitInstanceBuffer(device)
+        && this->InitCullPipeline(device)
+        && this->InitCullBuffers(device);
+}
 
-    wgpu::BufferDescriptor bufferDesc{
-        .label = "cube_vertex_buffer",
-        .usage = wgpu::BufferUsage::CopyDst | wgpu::BufferUsage::Vertex,
-        .size = (uint64_t)(quadVertices.size() * sizeof(VertexAttributes)),
-        .mappedAtCreation = false,
-    };
+void CubeShader::SetGpuCulling(const bool enabled) {
+    this->gpuCulling = enabled;
+    this->staticBundleDirty = true;
+}
+
+void CubeShader::SetAnimatedMesh(const MeshId mesh) {
+    this->animatedMesh = mesh;
+    this->staticBundleDirty = true;
+}
 
-    this->vertexBuffer = std::make_unique<wgpu::Buffer>(device.CreateBuffer(&bufferDesc));
-    if (this->vertexBuffer == nullptr) {
-        return false;
+void CubeShader::SetDepthPrePass(const bool enabled) {
+    this->depthPrePass = enabled;
+    this->staticBundleDirty = true;
+}
+
+auto CubeShader::AddStaticDraw(const MeshId mesh, const MeshMaterial material, std::span<const std::byte> instances) -> StaticDrawId {
+    this->staticDraws.push_back(StaticDraw{.mesh = mesh, .material = material});
+    const auto id = (StaticDrawId)(this->staticDraws.size() - 1);
+    this->UpdateStaticDraw(id, instances);
+    return id;
+}
+
+void CubeShader::UpdateStaticDraw(const StaticDrawId id, std::span<const std::byte> instances) {
+    StaticDraw &draw = this->staticDraws[id];
+    draw.pendingInstances.assign(instances.begin(), instances.end());
+    draw.pending = true;
+}
+
+void CubeShader::RemoveStaticDraw(const StaticDrawId id) {
+    this->UpdateStaticDraw(id, {});
+}
+
+void CubeShader::UploadStaticDraws(const wgpu::Queue &queue) {
+    for (auto &draw : this->staticDraws) {
+        if (draw.pending && !this->WriteStaticDraw(queue, draw)) {
+            draw.instanceCount = 0;
+        }
+        draw.pending = false;
+        draw.pendingInstances = {};
+    }
+}
+
+auto CubeShader::WriteStaticDraw(const wgpu::Queue &queue, StaticDraw &draw) -> bool {
+    const uint64_t size = draw.pendingInstances.size();
+    const auto instanceCount = (uint32_t)(size / this->GetInstanceStride());
+
+    if (draw.instanceBuffer == nullptr || draw.bufferSize < size) {
+        wgpu::BufferDescriptor bufferDesc{
+            .label = "cube_static_instance_buffer",
+            .usage = wgpu::BufferUsage::CopyDst | wgpu::BufferUsage::Vertex,
+            .size = std::max<uint64_t>(size, 4),
+            .mappedAtCreation = false,
+        };
+        draw.instanceBuffer = std::make_unique<wgpu::Buffer>(this->device.CreateBuffer(&bufferDesc));
+        draw.bufferSize = bufferDesc.size;
+        this->staticBundleDirty = true;  // Recorded with the old buffer
+        if (!*draw.instanceBuffer) {
+            return false;
+        }
     }
 
-    queue.WriteBuffer(this->vertexBuffer->Get(), 0, quadVertices.data(), quadVertices.size() * sizeof(VertexAttributes));
+    if (size > 0) {
+        queue.WriteBuffer(draw.instanceBuffer->Get(), 0, draw.pendingInstances.data(), size);
+    }
 
+    // Same buffer and count replay the existing bundle with the new contents.
+    if (draw.instanceCount != instanceCount) {
+        draw.instanceCount = instanceCount;
+        this->staticBundleDirty = true;
+    }
     return true;
 }
 
-auto CubeShader::InitInstanceBuffer(const wgpu::Device &device) -> bool {
-    wgpu::BufferDescriptor bufferDesc{
-        .label = "cube_index_buffer",
-        .usage = wgpu::BufferUsage::CopyDst | wgpu::BufferUsage::Vertex,
-        .size = (uint64_t)(this->maxCubeCount * sizeof(glm::mat4x4)),
-        .mappedAtCreation = false,
+void CubeShader::UpdateBuffers(UploadRing &uploadRing, DrawQueue &drawQueue) {
+    ProfileScope profileScope("CubeShader::UpdateBuffers");
+
+    this->draws.clear();
+
+    const uint64_t size = drawQueue.GetInstanceBytes();
+    if (size == 0 || !this->instanceBuffer->Next(size)) {
+        return;
+    }
+
+    auto *instances = static_cast<std::byte *>(uploadRing.Allocate(this->instanceBuffer->Get(), 0, size));
+    this->draws = drawQueue.Build(instances);
+}
+
+void CubeShader::UpdateAnimatedBuffers(const wgpu::Queue &queue, const std::vector<AnimatedCubeInstance> &animatedInstances) {
+    const uint64_t size = animatedInstances.size() * sizeof(AnimatedCubeInstance);
+
+    this->animatedInstanceCount = animatedInstances.size();
+    this->staticBundleDirty = true;
+    if (!this->animatedInstanceBuffer->Write(queue, animatedInstances.data(), size)
+        || !this->culledInstanceBuffer->Reserve(size)
+        || !this->InitCullBindGroup(this->device)) {  // Either buffer may have been reallocated
+        this->animatedInstanceCount = 0;
+    }
+}
+
+void CubeShader::UpdateCullUniforms(UploadRing &uploadRing, const glm::mat4x4 &viewProjectionMatrix) {
+    if (!this->gpuCulling || this->animatedInstanceCount == 0) {
+        return;
+    }
+
+    const MeshRange &mesh = this->meshRegistry->Get(this->animatedMesh);
+
+    auto *cullUniforms = static_cast<CubeCullUniforms *>(uploadRing.Allocate(this->cullUniformBuffer->Get(), 0, sizeof(CubeCullUniforms)));
+    *cullUniforms = CubeCullUniforms{
+        .planes = ExtractFrustum(viewProjectionMatrix).planes,
+        .instanceCount = (uint32_t)this->animatedInstanceCount,
+        .boundingRadius = mesh.boundingRadius,
+    };
+
+    // The compute pass appends visible instances by atomically bumping instanceCount.
+    auto *drawArgs = static_cast<DrawIndexedIndirectArgs *>(uploadRing.Allocate(this->indirectBuffer->Get(), 0, sizeof(DrawIndexedIndirectArgs)));
+    *drawArgs = DrawIndexedIndirectArgs{
+        .indexCount = mesh.indexCount,
+        .instanceCount = 0,
+        .firstIndex = mesh.firstIndex,
+        .baseVertex = mesh.baseVertex,
+        .firstInstance = 0,
+    };
+}
+
+void CubeShader::Cull(const wgpu::CommandEncoder &encoder, const wgpu::ComputePassTimestampWrites *timestampWrites) {
+    if (!this->gpuCulling || this->animatedInstanceCount == 0) {
+        return;
+    }
+
+    ProfileScope profileScope("CubeShader::Cull");
+
+    wgpu::ComputePassDescriptor computePassDesc{
+        .label = "cube cull",
+        .timestampWrites = timestampWrites,
     };
+    wgpu::ComputePassEncoder computePass = encoder.BeginComputePass(&computePassDesc);
+    computePass.SetPipeline(this->cullPipeline->Get());
+    computePass.SetBindGroup(0, this->cullBindGroup->Get(), 0, nullptr);
+    computePass.DispatchWorkgroups(((uint32_t)this->animatedInstanceCount + cullWorkgroupSize - 1) / cullWorkgroupSize);
+    computePass.End();
+}
+
+void CubeShader::Render(const wgpu::RenderPassEncoder &renderPass) {
+    ProfileScope profileScope("CubeShader::Render");
+
+    if (this->staticBundleDirty || this->staticBundleMeshVersion != this->meshRegistry->GetVersion()) {
+        this->RecordStaticBundle();
+    }
+
+    // Every mesh shares these buffers, and every draw reads its own instance range of one buffer,
+    // so draws only differ in their pipeline, which DrawQueue sorted them by.
+    const bool hasDraws = !this->draws.empty();
+    if (hasDraws) {
+        this->meshRegistry->Bind(renderPass);
+        renderPass.SetVertexBuffer(1, this->instanceBuffer->Get());
+    }
+
+    if (this->depthPrePass) {
+        if (this->staticDepthBundle != nullptr) {
+            const wgpu::RenderBundle bundle = *this->staticDepthBundle;
+            renderPass.ExecuteBundles(1, &bundle);
+
+            // Executing a bundle clears the pass state.
+            renderPass.SetBindGroup(FrameGlobals::bindGroupIndex, this->frameBindGroup, 0, nullptr);
+            if (hasDraws) {
+                this->meshRegistry->Bind(renderPass);
+                renderPass.SetVertexBuffer(1, this->instanceBuffer->Get());
+            }
+        }
+        this->EncodeDraws(renderPass, this->depthPipelines);
+    }
+    this->EncodeDraws(renderPass, this->depthPrePass ? this->afterPrePassPipelines : this->pipelines);
 
-    this->instanceBuffer = std::make_unique<wgpu::Buffer>(device.CreateBuffer(&bufferDesc));
-    return this->instanceBuffer != nullptr;
+    if (this->staticBundle != nullptr) {
+        const wgpu::RenderBundle bundle = *this->staticBundle;
+        renderPass.ExecuteBundles(1, &bundle);
+    }
 }
 
-auto CubeShader::Init(const wgpu::Device &device, const wgpu::TextureFormat swapChainFormat, const wgpu::TextureFormat depthTextureFormat, const wgpu::Queue &queue) -> bool {
-    return this->InitBindGroupLayout(device)
-        && this->InitRenderPipeline(device, swapChainFormat, depthTextureFormat)
-        && this->InitUniforms(device)
-        && this->InitBindGroup(device, this->uniformBuffer->Get(), this->bindGroupLayout->Get())
-        && this->InitVertexBuffer(device, queue)
-        && this->InitInstanceBuffer(device);
+void CubeShader::EncodeDraws(const wgpu::RenderPassEncoder &renderPass, const PipelineSet &pipelineSet) const {
+    const wgpu::RenderPipeline *boundPipeline = nullptr;
+    for (const auto &draw : this->draws) {
+        const wgpu::RenderPipeline *pipeline = pipelineSet.materials[draw.pipeline].get();
+        if (pipeline != boundPipeline) {
+            renderPass.SetPipeline(pipeline->Get());
+            boundPipeline = pipeline;
+        }
+
+        const MeshRange &mesh = this->meshRegistry->Get(draw.mesh);
+        renderPass.DrawIndexed(mesh.indexCount, draw.instanceCount, mesh.firstIndex, mesh.baseVertex, draw.firstInstance);
+    }
 }
 
-void CubeShader::UpdateBuffers(const wgpu::Queue &queue, std::vector<glm::mat4x4> &instanceModelMatrices) {
-    queue.WriteBuffer(this->instanceBuffer->Get(), 0, instanceModelMatrices.data(), instanceModelMatrices.size() * sizeof(glm::mat4x4));
-    this->instanceCount = instanceModelMatrices.size();
+void CubeShader::RecordStaticBundle() {
+    ProfileScope profileScope("CubeShader::RecordStaticBundle");
+
+    this->staticBundleDirty = false;
+    this->staticBundleMeshVersion = this->meshRegistry->GetVersion();
+    this->staticBundle = this->RecordRetainedDraws(this->depthPrePass ? this->afterPrePassPipelines : this->pipelines, false);
+    this->staticDepthBundle = this->depthPrePass ? this->RecordRetainedDraws(this->depthPipelines, true) : nullptr;
 }
 
-void CubeShader::Render(const wgpu::RenderPassEncoder &renderPass, const wgpu::Queue &queue, const glm::mat4x4 cameraViewMatrix, const glm::mat4x4 projectionMatrix, const float time) {
-    MyUniforms uniforms = this->uniforms;
-    uniforms.time = time;
+auto CubeShader::RecordRetainedDraws(const PipelineSet &pipelineSet, const bool depthOnly) -> std::unique_ptr<wgpu::RenderBundle> {
+    // Sorted so every pipeline is set once.
+    std::vector<const StaticDraw *> sortedDraws;
+    for (const auto &draw : this->staticDraws) {
+        if (draw.instanceCount > 0) {
+            sortedDraws.push_back(&draw);
+        }
+    }
+    std::stable_sort(sortedDraws.begin(), sortedDraws.end(), [](const StaticDraw *a, const StaticDraw *b) {
+        return std::tie(a->material, a->mesh) < std::tie(b->material, b->mesh);
+    });
 
-    this->uniforms.viewMatrix = cameraViewMatrix;
-    this->uniforms.projectionMatrix = projectionMatrix;
+    if (sortedDraws.empty() && this->animatedInstanceCount == 0) {
+        return nullptr;
+    }
 
-    renderPass.SetPipeline(this->pipeline->Get());
-    renderPass.SetVertexBuffer(0, this->vertexBuffer->Get());
-    renderPass.SetVertexBuffer(1, this->instanceBuffer->Get());
+    wgpu::RenderBundleEncoderDescriptor bundleDesc{
+        .label = depthOnly ? "cube_static_depth_bundle" : "cube_static_bundle",
+        .colorFormatCount = 1,
+        .colorFormats = &this->swapChainFormat,
+        .depthStencilFormat = this->depthTextureFormat,
+        .sampleCount = 1,
+    };
+    wgpu::RenderBundleEncoder bundleEncoder = this->device.CreateRenderBundleEncoder(&bundleDesc);
+
+    // Bundles start from an empty state, the pass's bind groups are not inherited.
+    bundleEncoder.SetBindGroup(FrameGlobals::bindGroupIndex, this->frameBindGroup, 0, nullptr);
+    this->meshRegistry->Bind(bundleEncoder);
+
+    if (this->animatedInstanceCount > 0) {
+        const MeshRange &mesh = this->meshRegistry->Get(this->animatedMesh);
+        bundleEncoder.SetPipeline(pipelineSet.animated->Get());
+
+        // The indirect arguments are rewritten every frame by the cull pass, the bundle only references them.
+        if (this->gpuCulling) {
+            bundleEncoder.SetVertexBuffer(1, this->culledInstanceBuffer->Get());
+            bundleEncoder.DrawIndexedIndirect(this->indirectBuffer->Get(), 0);
+        } else {
+            bundleEncoder.SetVertexBuffer(1, this->animatedInstanceBuffer->Get());
+            bundleEncoder.DrawIndexed(mesh.indexCount, this->animatedInstanceCount, mesh.firstIndex, mesh.baseVertex, 0);
+        }
+    }
 
-    uint32_t dynamicOffset = 0;
-    queue.WriteBuffer(this->uniformBuffer->Get(), dynamicOffset, &uniforms, sizeof(MyUniforms));
-    renderPass.SetBindGroup(0, this->bindGroup->Get(), 1, &dynamicOffset);
+    const wgpu::RenderPipeline *boundPipeline = nullptr;
+    for (const StaticDraw *draw : sortedDraws) {
+        const wgpu::RenderPipeline *pipeline = pipelineSet.materials[(size_t)draw->material].get();
+        if (pipeline != boundPipeline) {
+            bundleEncoder.SetPipeline(pipeline->Get());
+            boundPipeline = pipeline;
+        }
+
+        const MeshRange &mesh = this->meshRegistry->Get(draw->mesh);
+        bundleEncoder.SetVertexBuffer(1, draw->instanceBuffer->Get());
+        bundleEncoder.DrawIndexed(mesh.indexCount, draw->instanceCount, mesh.firstIndex, mesh.baseVertex, 0);
+    }
 
-    renderPass.Draw(14, this->instanceCount, 0, 0);
+    wgpu::RenderBundleDescriptor finishDesc{.label = bundleDesc.label};
+    return std::make_unique<wgpu::RenderBundle>(bundleEncoder.Finish(&finishDesc));
 }
@@ -2,7 +2,15 @@
 #include <webgpu/webgpu_cpp.h>
 #include <glm/glm.hpp>
 #include <memory>
+#include <array>
+#include <span>
 #include <vector>
+#include "../drawQueue.hpp"
+#include "../dynamicBuffer.hpp"
+#include "../frameGlobals.hpp"
+#include "../instancePacking.hpp"
+#include "../meshRegistry.hpp"
+#include "../uploadRing.hpp"
 
 struct Cube {
     glm::vec3 topLeft;
@@ -11,45 +19,115 @@ struct Cube {
     glm::vec3 bottomRight;
 };
 
-// Should be the same as in the shader.
-struct MyUniforms {
-    glm::mat4x4 viewMatrix;
-    glm::mat4x4 projectionMatrix;
-    float time;
-    float _pad[3];
+// Should be the same as in cube_cull.wgsl.
+struct CubeCullUniforms {
+    std::array<glm::vec4, 6> planes;
+    uint32_t instanceCount;
+    float boundingRadius;  // Of the animated mesh at scale 1
+    uint32_t _pad[2];
 };
-// Have the compiler check byte alignment
-static_assert(sizeof(MyUniforms) % 16 == 0);
+static_assert(sizeof(CubeCullUniforms) % 16 == 0);
+
+// Fragment shading of the per-frame instanced draws, each one is its own pipeline.
+// Used as the DrawCommand pipeline.
+enum class MeshMaterial : uint32_t {
+    Lit,       // fs_main, fixed directional light
+    Unlit,     // fs_unlit, vertex color only
+    Impostor,  // fs_main on a camera-facing quad, for BuildImpostorMesh meshes
+};
+constexpr size_t meshMaterialCount = 3;
+
+using StaticDrawId = uint32_t;
 
 class CubeShader {
    public:
-    CubeShader(size_t maxCubeCount);
+    CubeShader(size_t initialCubeCount, CubeInstanceFormat instanceFormat = CubeInstanceFormat::ModelMatrix);
     ~CubeShader() = default;
     CubeShader(const CubeShader &) = delete;
     CubeShader(CubeShader &&) = delete;
     auto operator=(const CubeShader &) -> CubeShader & = delete;
     auto operator=(CubeShader &&) -> CubeShader & = delete;
 
-    auto Init(const wgpu::Device &device, const wgpu::TextureFormat swapChainFormat, const wgpu::TextureFormat depthTextureFormat, const wgpu::Queue &queue) -> bool;
-    void UpdateBuffers(const wgpu::Queue &queue, std::vector<glm::mat4x4> &instanceModelMatrices);
-    void Render(const wgpu::RenderPassEncoder &renderPass, const wgpu::Queue &queue, const glm::mat4x4 cameraViewMatrix, const glm::mat4x4 projectionMatrix, const float time);
+    auto Init(const wgpu::Device &device, const wgpu::TextureFormat swapChainFormat, const wgpu::TextureFormat depthTextureFormat, const wgpu::CompareFunction depthCompare, const FrameGlobals &frameGlobals, const MeshRegistry &meshRegistry, const MeshId animatedMesh) -> bool;
+    // Builds the queued draws straight into the upload ring, instances have to be in the shader's format.
+    void UpdateBuffers(UploadRing &uploadRing, DrawQueue &drawQueue);
+    auto GetInstanceFormat() const -> CubeInstanceFormat;
+    void UpdateAnimatedBuffers(const wgpu::Queue &queue, const std::vector<AnimatedCubeInstance> &animatedInstances);
+    // Compacts the animated instances inside the frustum on the GPU, Render then draws them with DrawIndirect.
+    void SetGpuCulling(const bool enabled);
+    void SetAnimatedMesh(const MeshId mesh);
+    // Lays down depth with position-only pipelines first, so the color pass shades each covered pixel once.
+    // Pays off once fragment shading costs more than transforming every vertex twice.
+    void SetDepthPrePass(const bool enabled);
+    // Instances that rarely change, drawn with the animated instances from a render bundle that is only
+    // re-recorded when one of them changes. Never culled. Copied, and uploaded by UploadStaticDraws.
+    auto AddStaticDraw(const MeshId mesh, const MeshMaterial material, std::span<const std::byte> instances) -> StaticDrawId;
+    void UpdateStaticDraw(const StaticDrawId id, std::span<const std::byte> instances);
+    void RemoveStaticDraw(const StaticDrawId id);
+    void UploadStaticDraws(const wgpu::Queue &queue);
+    void UpdateCullUniforms(UploadRing &uploadRing, const glm::mat4x4 &viewProjectionMatrix);
+    void Cull(const wgpu::CommandEncoder &encoder, const wgpu::ComputePassTimestampWrites *timestampWrites = nullptr);
+    // Expects the FrameGlobals bind group to be set on the pass.
+    // Ends with the render bundle, which resets the pass state. With the depth pre-pass it starts with one as well.
+    void Render(const wgpu::RenderPassEncoder &renderPass);
 
    private:
+    // One pipeline per material for the instanced draws, plus the animated one.
+    struct PipelineSet {
+        std::array<std::unique_ptr<wgpu::RenderPipeline>, meshMaterialCount> materials;
+        std::unique_ptr<wgpu::RenderPipeline> animated;
+    };
+
+    struct StaticDraw {
+        MeshId mesh;
+        MeshMaterial material;
+        std::unique_ptr<wgpu::Buffer> instanceBuffer;
+        uint64_t bufferSize = 0;
+        uint32_t instanceCount = 0;
+        std::vector<std::byte> pendingInstances;
+        bool pending = false;
+    };
+
     std::unique_ptr<wgpu::ShaderModule> shaderModule;
-    std::unique_ptr<wgpu::BindGroupLayout> bindGroupLayout;
-    std::unique_ptr<wgpu::RenderPipeline> pipeline;
-    std::unique_ptr<wgpu::Buffer> uniformBuffer;
-    std::unique_ptr<wgpu::BindGroup> bindGroup;
-    std::unique_ptr<wgpu::Buffer> vertexBuffer;
-    std::unique_ptr<wgpu::Buffer> instanceBuffer;
-    MyUniforms uniforms = MyUniforms();
-    size_t instanceCount = 0;
-    size_t maxCubeCount;
-
-    auto InitBindGroupLayout(const wgpu::Device &device) -> bool;
-    auto InitRenderPipeline(const wgpu::Device &device, const wgpu::TextureFormat swapChainFormat, const wgpu::TextureFormat depthTextureFormat) -> bool;
-    auto InitVertexBuffer(const wgpu::Device &device, const wgpu::Queue &queue) -> bool;
-    auto InitUniforms(const wgpu::Device &device) -> bool;
-    auto InitBindGroup(const wgpu::Device &device, const wgpu::Buffer &uniformBuffer, const wgpu::BindGroupLayout &bindGroupLayout) -> bool;
+    PipelineSet pipelines;
+    PipelineSet depthPipelines;         // Color writes masked, the materials only differ in name
+    PipelineSet afterPrePassPipelines;  // Depth tested with OrEqual against the pre-pass and not written
+    const MeshRegistry *meshRegistry = nullptr;
+    MeshId animatedMesh = 0;
+    std::vector<DrawCommand> draws;
+    std::unique_ptr<DynamicBuffer> instanceBuffer;
+    std::unique_ptr<DynamicBuffer> animatedInstanceBuffer;
+    std::unique_ptr<wgpu::ShaderModule> cullShaderModule;
+    std::unique_ptr<wgpu::BindGroupLayout> cullBindGroupLayout;
+    std::unique_ptr<wgpu::ComputePipeline> cullPipeline;
+    std::unique_ptr<wgpu::Buffer> cullUniformBuffer;
+    std::unique_ptr<wgpu::BindGroup> cullBindGroup;
+    std::unique_ptr<DynamicBuffer> culledInstanceBuffer;
+    std::unique_ptr<wgpu::Buffer> indirectBuffer;
+    wgpu::Device device;
+    wgpu::BindGroup frameBindGroup;
+    wgpu::TextureFormat swapChainFormat = wgpu::TextureFormat::Undefined;
+    wgpu::TextureFormat depthTextureFormat = wgpu::TextureFormat::Undefined;
+    std::vector<StaticDraw> staticDraws;
+    std::unique_ptr<wgpu::RenderBundle> staticBundle;
+    std::unique_ptr<wgpu::RenderBundle> staticDepthBundle;
+    bool staticBundleDirty = true;
+    uint32_t staticBundleMeshVersion = 0;
+    size_t animatedInstanceCount = 0;
+    bool gpuCulling = false;
+    bool depthPrePass = false;
+    size_t initialCubeCount;
+    CubeInstanceFormat instanceFormat;
+
+    auto GetInstanceStride() const -> uint64_t;
+
+    auto InitRenderPipeline(const wgpu::Device &device, const wgpu::TextureFormat swapChainFormat, const wgpu::TextureFormat depthTextureFormat, const wgpu::CompareFunction depthCompare, const wgpu::BindGroupLayout &frameBindGroupLayout) -> bool;
     auto InitInstanceBuffer(const wgpu::Device &device) -> bool;
+    auto InitCullPipeline(const wgpu::Device &device) -> bool;
+    auto InitCullBuffers(const wgpu::Device &device) -> bool;
+    auto InitCullBindGroup(const wgpu::Device &device) -> bool;
+    auto WriteStaticDraw(const wgpu::Queue &queue, StaticDraw &draw) -> bool;
+    void RecordStaticBundle();
+    auto RecordRetainedDraws(const PipelineSet &pipelineSet, const bool depthOnly) -> std::unique_ptr<wgpu::RenderBundle>;
+    void EncodeDraws(const wgpu::RenderPassEncoder &renderPass, const PipelineSet &pipelineSet) const;
 };
@@ -5,20 +5,43 @@ struct VertexInput {
     @location(3) modelMatrix1: vec4<f32>,   // Second column of the matrix
     @location(4) modelMatrix2: vec4<f32>,   // Third column of the matrix
     @location(5) modelMatrix3: vec4<f32>,   // Fourth column of the matrix
+    @location(6) normal: vec3<f32>,
+};
+
+struct CompactVertexInput {
+    @location(0) position: vec3<f32>,
+    @location(1) color: vec3<f32>,
+    @location(2) translationScale: vec4<f32>,   // xyz translation, w uniform scale
+    @location(3) rotation: vec4<f32>,           // Quaternion xyzw, Snorm16x4
+    @location(6) normal: vec3<f32>,
+};
+
+struct AnimatedVertexInput {
+    @location(0) position: vec3<f32>,
+    @location(1) color: vec3<f32>,
+    @location(2) instancePosition: vec3<f32>,
+    @location(3) instanceScale: f32,
+    @location(4) rotationAxis: vec3<f32>,
+    @location(5) rotationSpeed: f32,        // Radians per second
+    @location(6) normal: vec3<f32>,
 };
 
 struct VertexOutput {
-	@builtin(position) position: vec4<f32>,
+	@builtin(position) @invariant position: vec4<f32>,  // The depth pre-pass relies on identical depth in both passes
 	@location(0) color: vec3<f32>,
+	@location(1) normal: vec3<f32>,         // World space, scale is uniform so no inverse transpose
 };
 
-struct Uniforms {
+// Should be the same as FrameUniforms in frameGlobals.hpp.
+struct Frame {
     viewMatrix: mat4x4<f32>,
     projectionMatrix: mat4x4<f32>,
+    viewProjectionMatrix: mat4x4<f32>,
     time: f32,
+    viewportSize: vec2<f32>,
 };
 
-@group(0) @binding(0) var<uniform> uniforms: Uniforms;
+@group(0) @binding(0) var<uniform> frame: Frame;
 
 @vertex
 fn vs_main(in: VertexInput) -> VertexOutput {
@@ -29,14 +52,96 @@ fn vs_main(in: VertexInput) -> VertexOutput {
         in.modelMatrix3
     );
     var out: VertexOutput;
-    var position = vec4<f32>(in.position, 1.0);
-    out.position = uniforms.projectionMatrix * uniforms.viewMatrix * modelMatrix * position;
+    let worldPosition = modelMatrix * vec4<f32>(in.position, 1.0);
+    out.position = frame.viewProjectionMatrix * worldPosition;
+
+    out.color = in.color;
+    out.normal = (modelMatrix * vec4<f32>(in.normal, 0.0)).xyz;
+    return out;
+}
+
+fn rotateByQuaternion(v: vec3<f32>, q: vec4<f32>) -> vec3<f32> {
+    let t = 2.0 * cross(q.xyz, v);
+    return v + q.w * t + cross(q.xyz, t);
+}
+
+@vertex
+fn vs_compact(in: CompactVertexInput) -> VertexOutput {
+    let rotation = normalize(in.rotation);
+    let worldPosition = rotateByQuaternion(in.position * in.translationScale.w, rotation) + in.translationScale.xyz;
+
+    var out: VertexOutput;
+    out.position = frame.viewProjectionMatrix * vec4<f32>(worldPosition, 1.0);
+
+    out.color = in.color;
+    out.normal = rotateByQuaternion(in.normal, rotation);
+    return out;
+}
+
+// Impostors ignore the instance rotation and turn the mesh's xy plane towards the camera,
+// which stays lit as if it were the face seen head-on.
+fn billboard(position: vec3<f32>, center: vec3<f32>, scale: f32) -> VertexOutput {
+    let right = vec3<f32>(frame.viewMatrix[0].x, frame.viewMatrix[1].x, frame.viewMatrix[2].x);
+    let up = vec3<f32>(frame.viewMatrix[0].y, frame.viewMatrix[1].y, frame.viewMatrix[2].y);
+    let towardsCamera = vec3<f32>(frame.viewMatrix[0].z, frame.viewMatrix[1].z, frame.viewMatrix[2].z);
+    let worldPosition = center + (right * position.x + up * position.y) * scale;
+
+    var out: VertexOutput;
+    out.position = frame.viewProjectionMatrix * vec4<f32>(worldPosition, 1.0);
+    out.normal = towardsCamera;
+    return out;
+}
+
+@vertex
+fn vs_impostor(in: VertexInput) -> VertexOutput {
+    var out = billboard(in.position, in.modelMatrix3.xyz, length(in.modelMatrix0.xyz));
+    out.color = in.color;
+    return out;
+}
+
+@vertex
+fn vs_compact_impostor(in: CompactVertexInput) -> VertexOutput {
+    var out = billboard(in.position, in.translationScale.xyz, in.translationScale.w);
+    out.color = in.color;
+    return out;
+}
+
+// Rodrigues' rotation formula, column-major like glm::rotate.
+fn axisAngleMatrix(axis: vec3<f32>, angle: f32) -> mat3x3<f32> {
+    let a = normalize(axis);
+    let c = cos(angle);
+    let s = sin(angle);
+    let t = 1.0 - c;
+    return mat3x3<f32>(
+        vec3<f32>(t * a.x * a.x + c, t * a.x * a.y + s * a.z, t * a.x * a.z - s * a.y),
+        vec3<f32>(t * a.x * a.y - s * a.z, t * a.y * a.y + c, t * a.y * a.z + s * a.x),
+        vec3<f32>(t * a.x * a.z + s * a.y, t * a.y * a.z - s * a.x, t * a.z * a.z + c)
+    );
+}
+
+@vertex
+fn vs_animated(in: AnimatedVertexInput) -> VertexOutput {
+    let rotation = axisAngleMatrix(in.rotationAxis, in.rotationSpeed * frame.time);
+    let worldPosition = rotation * (in.position * in.instanceScale) + in.instancePosition;
+
+    var out: VertexOutput;
+    out.position = frame.viewProjectionMatrix * vec4<f32>(worldPosition, 1.0);
 
     out.color = in.color;
+    out.normal = rotation * in.normal;
     return out;
 }
 
+const lightDirection = vec3<f32>(0.3713907, 0.7427814, 0.5570860);  // normalize(2, 4, 3)
+const ambient = 0.35;
+
 @fragment
 fn fs_main(in: VertexOutput) -> @location(0) vec4<f32> {
+    let diffuse = max(dot(normalize(in.normal), lightDirection), 0.0);
+    return vec4<f32>(in.color * (ambient + (1.0 - ambient) * diffuse), 1.0);
+}
+
+@fragment
+fn fs_unlit(in: VertexOutput) -> @location(0) vec4<f32> {
     return vec4<f32>(in.color, 1.0);
 }
@@ -0,0 +1,46 @@
+// Should be the same as AnimatedCubeInstance in instancePacking.hpp.
+struct AnimatedCubeInstance {
+    position: vec3<f32>,
+    scale: f32,
+    rotationAxis: vec3<f32>,
+    rotationSpeed: f32,
+};
+
+struct CullUniforms {
+    planes: array<vec4<f32>, 6>,    // Facing into the frustum, xyz normal, w distance
+    instanceCount: u32,
+    boundingRadius: f32,            // Of the mesh at scale 1
+};
+
+// Layout of the arguments read by DrawIndexedIndirect.
+struct DrawIndexedIndirectArgs {
+    indexCount: u32,
+    instanceCount: atomic<u32>,
+    firstIndex: u32,
+    baseVertex: i32,
+    firstInstance: u32,
+};
+
+@group(0) @binding(0) var<uniform> uniforms: CullUniforms;
+@group(0) @binding(1) var<storage, read> instances: array<AnimatedCubeInstance>;
+@group(0) @binding(2) var<storage, read_write> visibleInstances: array<AnimatedCubeInstance>;
+@group(0) @binding(3) var<storage, read_write> drawArgs: DrawIndexedIndirectArgs;
+
+@compute @workgroup_size(64)
+fn cs_main(@builtin(global_invocation_id) id: vec3<u32>) {
+    if (id.x >= uniforms.instanceCount) {
+        return;
+    }
+
+    let instance = instances[id.x];
+    let radius = abs(instance.scale) * uniforms.boundingRadius;
+    for (var i = 0u; i < 6u; i++) {
+        let plane = uniforms.planes[i];
+        if (dot(plane.xyz, instance.position) + plane.w < -radius) {
+            return;
+        }
+    }
+
+    let slot = atomicAdd(&drawArgs.instanceCount, 1u);
+    visibleInstances[slot] = instance;
+}
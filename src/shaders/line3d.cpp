@@ -1,8 +1,10 @@
 #include "line3d.hpp"
+#include <algorithm>
+#include <cmath>
 #include <cstddef>
+#include "../profiler.hpp"
 #include "../resourceManager.hpp"
 #include "glm/ext/matrix_clip_space.hpp"
-#include "glm/ext/matrix_transform.hpp"
 #include "glm/fwd.hpp"
 
 // offsetof from std lib has trouble with VSCode intellisense, override.
@@ -11,18 +13,21 @@ constexpr auto offsetOfMember(U T::*member) -> size_t {
     return (char *)&((T *)nullptr->*member) - (char *)nullptr;
 }
 
-struct VertexAttributes {
-    glm::vec3 position;
-    glm::vec3 color;
-};
+auto PackLineColor(const glm::vec4 color) -> uint32_t {
+    uint32_t packed = 0;
+    for (int channel = 0; channel < 4; ++channel) {
+        packed |= (uint32_t)std::lround(std::clamp(color[channel], 0.0f, 1.0f) * 255.0f) << (channel * 8);  // r in the lowest byte, the first read by Unorm8x4
+    }
+    return packed;
+}
 
-Line3DShader::Line3DShader(size_t maxLineCount) : maxLineCount(maxLineCount) {}
+Line3DShader::Line3DShader(size_t initialLineCount) : initialLineCount(initialLineCount) {}
 
 auto Line3DShader::InitBindGroupLayout(const wgpu::Device &device) -> bool {
     std::array<wgpu::BindGroupLayoutEntry, 1> bindingLayoutEntries{
         wgpu::BindGroupLayoutEntry{
             .binding = 0,
-            .visibility = wgpu::ShaderStage::Vertex | wgpu::ShaderStage::Fragment,
+            .visibility = wgpu::ShaderStage::Vertex,
             .buffer = wgpu::BufferBindingLayout{
                 .type = wgpu::BufferBindingType::Uniform,
                 .hasDynamicOffset = true,
@@ -41,27 +46,31 @@ auto Line3DShader::InitBindGroupLayout(const wgpu::Device &device) -> bool {
     return this->bindGroupLayout != nullptr;
 }
 
-auto Line3DShader::InitRenderPipeline(const wgpu::Device &device, const wgpu::TextureFormat swapChainFormat, const wgpu::TextureFormat depthTextureFormat) -> bool {
+auto Line3DShader::InitRenderPipeline(const wgpu::Device &device, const wgpu::TextureFormat swapChainFormat, const wgpu::TextureFormat depthTextureFormat, const wgpu::CompareFunction depthCompare, const wgpu::BindGroupLayout &frameBindGroupLayout) -> bool {
     this->shaderModule = ResourceManager::LoadShaderModule("/src/shaders/line3d.wgsl", device);
 
-    std::array<wgpu::VertexAttribute, 2> vertexAttribs{
-        // Position attribute
+    std::array<wgpu::VertexAttribute, 3> vertexAttribs{
         wgpu::VertexAttribute{
             .format = wgpu::VertexFormat::Float32x3,
-            .offset = offsetOfMember(&VertexAttributes::position),
+            .offset = offsetOfMember(&Line3D::start),
             .shaderLocation = 0,
         },
-        // Color attribute
         wgpu::VertexAttribute{
             .format = wgpu::VertexFormat::Float32x3,
-            .offset = offsetOfMember(&VertexAttributes::color),
+            .offset = offsetOfMember(&Line3D::end),
             .shaderLocation = 1,
         },
+        wgpu::VertexAttribute{
+            .format = wgpu::VertexFormat::Unorm8x4,
+            .offset = offsetOfMember(&Line3D::color),
+            .shaderLocation = 2,
+        },
     };
 
+    // The quad corners come from the vertex index, so the only buffer is per instance.
     wgpu::VertexBufferLayout vertexBufferLayout{
-        .arrayStride = sizeof(VertexAttributes),
-        .stepMode = wgpu::VertexStepMode::Vertex,
+        .arrayStride = sizeof(Line3D),
+        .stepMode = wgpu::VertexStepMode::Instance,
         .attributeCount = (uint32_t)vertexAttribs.size(),
         .attributes = vertexAttribs.data(),
     };
@@ -96,7 +105,7 @@ auto Line3DShader::InitRenderPipeline(const wgpu::Device &device, const wgpu::Te
     wgpu::DepthStencilState depthStencilState = {
         .format = depthTextureFormat,
         .depthWriteEnabled = true,
-        .depthCompare = wgpu::CompareFunction::Less,
+        .depthCompare = depthCompare,
         .stencilReadMask = 0,
         .stencilWriteMask = 0,
     };
@@ -112,7 +121,7 @@ auto Line3DShader::InitRenderPipeline(const wgpu::Device &device, const wgpu::Te
             .buffers = &vertexBufferLayout,
         },
         .primitive = wgpu::PrimitiveState{
-            .topology = wgpu::PrimitiveTopology::LineList,
+            .topology = wgpu::PrimitiveTopology::TriangleStrip,
             .stripIndexFormat = wgpu::IndexFormat::Undefined,
             .frontFace = wgpu::FrontFace::CCW,
             .cullMode = wgpu::CullMode::None,
@@ -126,10 +135,11 @@ auto Line3DShader::InitRenderPipeline(const wgpu::Device &device, const wgpu::Te
         .fragment = &fragmentState,
     };
 
+    auto bindGroupLayouts = std::array{frameBindGroupLayout, this->bindGroupLayout->Get()};
     wgpu::PipelineLayoutDescriptor layoutDesc{
         .label = "line3d",
-        .bindGroupLayoutCount = 1,
-        .bindGroupLayouts = this->bindGroupLayout.get(),
+        .bindGroupLayoutCount = (uint32_t)bindGroupLayouts.size(),
+        .bindGroupLayouts = bindGroupLayouts.data(),
     };
 
     pipelineDesc.layout = device.CreatePipelineLayout(&layoutDesc);
@@ -139,35 +149,13 @@ auto Line3DShader::InitRenderPipeline(const wgpu::Device &device, const wgpu::Te
     return this->pipeline != nullptr;
 }
 
-auto Line3DShader::InitUniforms(const wgpu::Device &device, const wgpu::Queue &queue, const uint32_t width, const uint32_t height) -> bool {
-    wgpu::BufferDescriptor bufferDesc{
-        .label = "line3d",
-        .usage = wgpu::BufferUsage::CopyDst | wgpu::BufferUsage::Uniform,
-        .size = sizeof(MyUniforms),
-        .mappedAtCreation = false,
-    };
-    this->uniformBuffer = std::make_unique<wgpu::Buffer>(device.CreateBuffer(&bufferDesc));
-
-    if (this->uniformBuffer == nullptr) {
-        return false;
-    }
-
-    this->uniforms.modelMatrix = glm::mat4x4(1.0f);
-    this->uniforms.viewMatrix = glm::lookAt(glm::vec3(0.0f, 0.0f, 20.0f),  // Camera position in World Space
-                                            glm::vec3(0.0f, 0.0, 0.0f),    // and looks at the origin
-                                            glm::vec3(0.0f, 1.0f, 0.0f));  // Head is up
-    this->uniforms.projectionMatrix = glm::perspective(glm::radians(75.0f), float(width) / float(height), 0.1f, 1000.0f);
-    this->uniforms.time = 1.0f;
-    queue.WriteBuffer(this->uniformBuffer->Get(), 0, &this->uniforms, sizeof(MyUniforms));
+auto Line3DShader::InitBindGroup(const wgpu::Device &device, const wgpu::BindGroupLayout &bindGroupLayout) -> bool {
+    this->uniformArenaVersion = this->uniformArena->GetVersion();
 
-    return true;
-}
-
-auto Line3DShader::InitBindGroup(const wgpu::Device &device, const wgpu::Buffer &uniformBuffer, const wgpu::BindGroupLayout &bindGroupLayout) -> bool {
     std::array<wgpu::BindGroupEntry, 1> bindings = {
         wgpu::BindGroupEntry{
             .binding = 0,
-            .buffer = uniformBuffer.Get(),
+            .buffer = this->uniformArena->GetBuffer(),
             .offset = 0,
             .size = sizeof(MyUniforms),
         },
@@ -183,52 +171,64 @@ auto Line3DShader::InitBindGroup(const wgpu::Device &device, const wgpu::Buffer
     return this->bindGroup != nullptr;
 }
 
-auto Line3DShader::InitVertexBuffer(const wgpu::Device &device) -> bool {
-    wgpu::BufferDescriptor bufferDesc{
-        .label = "line3d",
-        .usage = wgpu::BufferUsage::CopyDst | wgpu::BufferUsage::Vertex,
-        .size = (uint64_t)this->maxLineCount * sizeof(Line3D),
-        .mappedAtCreation = false,
-    };
-    this->vertexBuffer = std::make_unique<wgpu::Buffer>(device.CreateBuffer(&bufferDesc));
-    return this->vertexBuffer != nullptr;
+auto Line3DShader::InitInstanceBuffer(const wgpu::Device &device) -> bool {
+    this->instanceBuffer = std::make_unique<DynamicBuffer>("line3d_instances", wgpu::BufferUsage::Vertex, (uint64_t)this->initialLineCount * sizeof(Line3D));
+    return this->instanceBuffer->Init(device);
 }
 
-void Line3DShader::Resize(const uint32_t width, const uint32_t height) {
-    this->uniforms.projectionMatrix = glm::perspective(glm::radians(75.0f), float(width) / float(height), 0.1f, 1000.0f);
-}
+auto Line3DShader::Init(const wgpu::Device &device, const wgpu::TextureFormat swapChainFormat, const wgpu::TextureFormat depthTextureFormat, const wgpu::CompareFunction depthCompare, const wgpu::BindGroupLayout &frameBindGroupLayout, UniformArena &uniformArena) -> bool {
+    this->device = device;
+    this->uniformArena = &uniformArena;
 
-auto Line3DShader::Init(const wgpu::Device &device, const wgpu::TextureFormat swapChainFormat, const wgpu::TextureFormat depthTextureFormat, const wgpu::Queue &queue, const uint32_t width, const uint32_t height) -> bool {
     return this->InitBindGroupLayout(device)
-        && this->InitRenderPipeline(device, swapChainFormat, depthTextureFormat)
-        && this->InitUniforms(device, queue, width, height)
-        && this->InitBindGroup(device, this->uniformBuffer->Get(), this->bindGroupLayout->Get())
-        && this->InitVertexBuffer(device);
+        && this->InitRenderPipeline(device, swapChainFormat, depthTextureFormat, depthCompare, frameBindGroupLayout)
+        && this->InitBindGroup(device, this->bindGroupLayout->Get())
+        && this->InitInstanceBuffer(device);
 }
 
-void Line3DShader::UpdateVertexBuffer(const wgpu::Queue &queue, const std::vector<Line3D> &lines) {
-    queue.WriteBuffer(this->vertexBuffer->Get(), 0, lines.data(), lines.size() * sizeof(Line3D));
+void Line3DShader::UpdateInstanceBuffer(UploadRing &uploadRing, const std::vector<Line3D> &lines) {
+    ProfileScope profileScope("Line3DShader::UpdateInstanceBuffer");
+
+    const uint64_t size = lines.size() * sizeof(Line3D);
     this->drawLineCount = lines.size();
+    if (this->drawLineCount > 0 && this->instanceBuffer->Next(size)) {
+        uploadRing.Write(this->instanceBuffer->Get(), 0, lines.data(), size);
+    } else {
+        this->drawLineCount = 0;
+    }
 }
 
-void Line3DShader::Render(const wgpu::RenderPassEncoder &renderPass, const wgpu::Queue &queue, const float time) {
-    MyUniforms uniforms = this->uniforms;
-    uniforms.time = time;
+void Line3DShader::UpdateDraws(const glm::mat4x4 &viewProjectionMatrix, std::span<const Line3DBatch> batches) {
+    this->draws.clear();
+    if (this->drawLineCount == 0) {
+        return;
+    }
 
-    auto angle = 20.0f * time;
+    for (const auto &batch : batches) {
+        this->draws.push_back(Draw{
+            .uniformOffset = this->uniformArena->Push(MyUniforms{.modelViewProjectionMatrix = viewProjectionMatrix * batch.transform, .width = batch.width, ._pad = {}}),
+            .firstLine = batch.firstLine,
+            .lineCount = batch.lineCount,
+        });
+    }
+}
 
-    glm::mat4 rotationMatrix =
-        glm::rotate(glm::mat4(1.0f), glm::radians(angle), glm::vec3(0.0f, 0.0f, 1.0f)) *  // Rotate around Z axis
-        glm::rotate(glm::mat4(1.0f), glm::radians(angle), glm::vec3(0.0f, 1.0f, 0.0f)) *  // Rotate around Y axis
-        glm::rotate(glm::mat4(1.0f), glm::radians(0.0f), glm::vec3(1.0f, 0.0f, 0.0f));    // Rotate around X axis
+void Line3DShader::Render(const wgpu::RenderPassEncoder &renderPass) {
+    if (this->draws.empty()) {
+        return;
+    }
 
-    this->uniforms.modelMatrix = rotationMatrix;  // glm::mat4x4(1.0f);
+    ProfileScope profileScope("Line3DShader::Render");
+
+    if (this->uniformArenaVersion != this->uniformArena->GetVersion() && !this->InitBindGroup(this->device, this->bindGroupLayout->Get())) {
+        return;
+    }
 
     renderPass.SetPipeline(this->pipeline->Get());
-    renderPass.SetVertexBuffer(0, this->vertexBuffer->Get(), 0, (uint64_t)this->drawLineCount * sizeof(Line3D));
+    renderPass.SetVertexBuffer(0, this->instanceBuffer->Get(), 0, (uint64_t)this->drawLineCount * sizeof(Line3D));
 
-    uint32_t dynamicOffset = 0;
-    queue.WriteBuffer(this->uniformBuffer->Get(), dynamicOffset, &uniforms, sizeof(MyUniforms));
-    renderPass.SetBindGroup(0, this->bindGroup->Get(), 1, &dynamicOffset);
-    renderPass.Draw(this->drawLineCount * 2, 1, 0, 0);
+    for (const auto &draw : this->draws) {
+        renderPass.SetBindGroup(1, this->bindGroup->Get(), 1, &draw.uniformOffset);
+        renderPass.Draw(4, draw.lineCount, 0, draw.firstLine);  // One quad strip per line
+    }
 }
\ No newline at end of file
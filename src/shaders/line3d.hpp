@@ -2,10 +2,29 @@
 #include <webgpu/webgpu_cpp.h>
 #include <glm/glm.hpp>
 #include <memory>
+#include <span>
+#include <vector>
+#include "../dynamicBuffer.hpp"
+#include "../uniformArena.hpp"
+#include "../uploadRing.hpp"
 
+// One instance per segment, expanded into a screen-aligned quad by the vertex shader.
+// The width is shared by the batch, see Line3DBatch.
 struct Line3D {
     glm::vec3 start;
     glm::vec3 end;
+    uint32_t color;  // RGBA8 unorm, see PackLineColor
+};
+static_assert(sizeof(Line3D) == 28);
+
+auto PackLineColor(const glm::vec4 color) -> uint32_t;
+
+// Consecutive lines sharing a model transform and width, drawn with one uniform block.
+struct Line3DBatch {
+    glm::mat4x4 transform;
+    float width;  // In pixels
+    uint32_t firstLine;
+    uint32_t lineCount;
 };
 
 // todo: irritate sonarlint.
@@ -13,42 +32,48 @@ class Line3DShader {
    private:
     // Should be the same as in the shader.
     struct MyUniforms {
-        glm::mat4x4 modelMatrix;
-        glm::mat4x4 viewMatrix;
-        glm::mat4x4 projectionMatrix;
-        float time;
+        glm::mat4x4 modelViewProjectionMatrix;  // Combined once per draw instead of per vertex
+        float width;
         float _pad[3];
     };
     // Have the compiler check byte alignment
     static_assert(sizeof(MyUniforms) % 16 == 0);
 
    public:
-    Line3DShader(const size_t maxLineCount);
+    Line3DShader(const size_t initialLineCount);
     ~Line3DShader() = default;
     Line3DShader(const Line3DShader &) = delete;
     Line3DShader(Line3DShader &&) = delete;
     auto operator=(const Line3DShader &) -> Line3DShader & = delete;
     auto operator=(Line3DShader &&) -> Line3DShader & = delete;
 
-    auto Init(const wgpu::Device &device, const wgpu::TextureFormat swapChainFormat, const wgpu::TextureFormat depthTextureFormat, const wgpu::Queue &queue, const uint32_t width, const uint32_t height) -> bool;
-    void Resize(const uint32_t width, const uint32_t height);
-    void UpdateVertexBuffer(const wgpu::Queue &queue, const std::vector<Line3D> &lines);
-    void Render(const wgpu::RenderPassEncoder &renderPass, const wgpu::Queue &queue, const float time);
+    auto Init(const wgpu::Device &device, const wgpu::TextureFormat swapChainFormat, const wgpu::TextureFormat depthTextureFormat, const wgpu::CompareFunction depthCompare, const wgpu::BindGroupLayout &frameBindGroupLayout, UniformArena &uniformArena) -> bool;
+    void UpdateInstanceBuffer(UploadRing &uploadRing, const std::vector<Line3D> &lines);
+    // One arena block and draw per batch, the batches index the lines given to UpdateInstanceBuffer.
+    void UpdateDraws(const glm::mat4x4 &viewProjectionMatrix, std::span<const Line3DBatch> batches);
+    // Expects the FrameGlobals bind group to be set on the pass.
+    void Render(const wgpu::RenderPassEncoder &renderPass);
 
    private:
     std::unique_ptr<wgpu::ShaderModule> shaderModule;
     std::unique_ptr<wgpu::BindGroupLayout> bindGroupLayout;
     std::unique_ptr<wgpu::RenderPipeline> pipeline;
-    std::unique_ptr<wgpu::Buffer> uniformBuffer;
+    wgpu::Device device;
+    UniformArena *uniformArena = nullptr;
+    uint32_t uniformArenaVersion = 0;
     std::unique_ptr<wgpu::BindGroup> bindGroup;
-    MyUniforms uniforms = MyUniforms();
-    std::unique_ptr<wgpu::Buffer> vertexBuffer;
+    std::unique_ptr<DynamicBuffer> instanceBuffer;
+    struct Draw {
+        uint32_t uniformOffset;  // Dynamic offset of the batch's block in the arena
+        uint32_t firstLine;
+        uint32_t lineCount;
+    };
+    std::vector<Draw> draws;
     size_t drawLineCount = 0;
-    size_t maxLineCount;
+    size_t initialLineCount;
 
     auto InitBindGroupLayout(const wgpu::Device &device) -> bool;
-    auto InitRenderPipeline(const wgpu::Device &device, const wgpu::TextureFormat swapChainFormat, const wgpu::TextureFormat depthTextureFormat) -> bool;
-    auto InitUniforms(const wgpu::Device &device, const wgpu::Queue &queue, const uint32_t width, const uint32_t height) -> bool;
-    auto InitBindGroup(const wgpu::Device &device, const wgpu::Buffer &uniformBuffer, const wgpu::BindGroupLayout &bindGroupLayout) -> bool;
-    auto InitVertexBuffer(const wgpu::Device &device) -> bool;
+    auto InitRenderPipeline(const wgpu::Device &device, const wgpu::TextureFormat swapChainFormat, const wgpu::TextureFormat depthTextureFormat, const wgpu::CompareFunction depthCompare, const wgpu::BindGroupLayout &frameBindGroupLayout) -> bool;
+    auto InitBindGroup(const wgpu::Device &device, const wgpu::BindGroupLayout &bindGroupLayout) -> bool;
+    auto InitInstanceBuffer(const wgpu::Device &device) -> bool;
 };
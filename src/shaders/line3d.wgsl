@@ -1,33 +1,80 @@
-struct VertexInput {
-	@location(0) position: vec3<f32>,
-	@location(1) color: vec3<f32>,
+// Should be the same as Line3D in line3d.hpp.
+struct LineInstance {
+	@location(0) start: vec3<f32>,
+	@location(1) end: vec3<f32>,
+	@location(2) color: vec4<f32>,
 };
 
 struct VertexOutput {
 	@builtin(position) position: vec4<f32>,
-	@location(0) color: vec3<f32>,
+	@location(0) color: vec4<f32>,
 };
 
-struct Uniforms {
-    modelMatrix: mat4x4<f32>,
+// Should be the same as FrameUniforms in frameGlobals.hpp.
+struct Frame {
     viewMatrix: mat4x4<f32>,
     projectionMatrix: mat4x4<f32>,
+    viewProjectionMatrix: mat4x4<f32>,
     time: f32,
+    viewportSize: vec2<f32>,
 };
 
-@group(0) @binding(0) var<uniform> uUniforms: Uniforms;
+// Should be the same as Line3DShader::MyUniforms.
+struct Uniforms {
+    modelViewProjectionMatrix: mat4x4<f32>,
+    width: f32,  // In pixels, shared by the batch
+};
+
+@group(0) @binding(0) var<uniform> frame: Frame;
+@group(1) @binding(0) var<uniform> uUniforms: Uniforms;
+
+// Points behind the camera have no meaningful screen position, so a point with w below nearW is moved
+// along the segment onto w = nearW. Tested on w rather than z so it holds with reverse-Z as well.
+const nearW = 1e-4;
 
+fn clipToNear(point: vec4<f32>, other: vec4<f32>) -> vec4<f32> {
+    if (point.w >= nearW) {
+        return point;
+    }
+    return mix(point, other, (nearW - point.w) / (other.w - point.w));
+}
+
+// Expanded from vertex indices 0..3 as a strip: start right, start left, end right, end left.
 @vertex
-fn vs_main(in: VertexInput) -> VertexOutput {
+fn vs_main(@builtin(vertex_index) vertexIndex: u32, line: LineInstance) -> VertexOutput {
     var out: VertexOutput;
-    var position = vec4<f32>(in.position, 1.0);
-    out.position = uUniforms.projectionMatrix * uUniforms.viewMatrix * uUniforms.modelMatrix * position;
+    out.color = line.color;
+
+    let startClip = uUniforms.modelViewProjectionMatrix * vec4<f32>(line.start, 1.0);
+    let endClip = uUniforms.modelViewProjectionMatrix * vec4<f32>(line.end, 1.0);
+    if (startClip.w < nearW && endClip.w < nearW) {
+        out.position = vec4<f32>(0.0, 0.0, 2.0, 1.0);  // Entirely behind the camera, outside the 0..1 depth range
+        return out;
+    }
+    let start = clipToNear(startClip, endClip);
+    let end = clipToNear(endClip, startClip);
+
+    let halfViewport = frame.viewportSize * 0.5;
+    let screenDelta = (end.xy / end.w - start.xy / start.w) * halfViewport;
+    var direction = vec2<f32>(1.0, 0.0);
+    if (dot(screenDelta, screenDelta) > 1e-8) {
+        direction = normalize(screenDelta);
+    }
+    let normal = vec2<f32>(-direction.y, direction.x);
+
+    let atEnd = (vertexIndex & 2u) != 0u;
+    let side = select(-1.0, 1.0, (vertexIndex & 1u) != 0u);
+    // Square caps, half a width past each end so joined segments leave no gap.
+    let along = select(-1.0, 1.0, atEnd);
+    let offsetPixels = (normal * side + direction * along) * (uUniforms.width * 0.5);
 
-    out.color = in.color;
+    var position = select(start, end, atEnd);
+    position = vec4<f32>(position.xy + offsetPixels / halfViewport * position.w, position.zw);
+    out.position = position;
     return out;
 }
 
 @fragment
 fn fs_main(in: VertexOutput) -> @location(0) vec4<f32> {
-    return vec4<f32>(in.color, 1.0);
+    return in.color;
 }
\ No newline at end of file
@@ -0,0 +1,50 @@
+#include "uniformArena.hpp"
+#include <cstring>
+
+UniformArena::UniformArena(const uint64_t initialSize) : buffer("uniform_arena", wgpu::BufferUsage::Uniform, initialSize, 1) {
+    this->blocks.reserve(initialSize);
+}
+
+auto UniformArena::Init(const wgpu::Device &device) -> bool {
+    wgpu::SupportedLimits supportedLimits{};
+    if (device.GetLimits(&supportedLimits)) {
+        this->alignment = supportedLimits.limits.minUniformBufferOffsetAlignment;
+    }
+
+    return this->buffer.Init(device);
+}
+
+auto UniformArena::Push(const void *data, const uint64_t size) -> uint32_t {
+    const uint64_t offset = (this->blocks.size() + this->alignment - 1) / this->alignment * this->alignment;
+
+    this->blocks.resize(offset + size);
+    std::memcpy(this->blocks.data() + offset, data, size);
+
+    return (uint32_t)offset;
+}
+
+void UniformArena::Flush(UploadRing &uploadRing) {
+    if (this->blocks.empty()) {
+        return;
+    }
+
+    // Single slot, the copy is ordered after the previous frame's draws on the queue.
+    if (this->blocks.size() > this->buffer.GetCapacity()) {
+        if (!this->buffer.Reserve(this->blocks.size())) {
+            this->blocks.clear();
+            return;
+        }
+        this->version++;
+    }
+
+    uploadRing.Write(this->buffer.Get(), 0, this->blocks.data(), this->blocks.size());
+    this->blocks.clear();
+}
+
+auto UniformArena::GetBuffer() const -> wgpu::Buffer {
+    return this->buffer.Get();
+}
+
+auto UniformArena::GetVersion() const -> uint32_t {
+    return this->version;
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <webgpu/webgpu_cpp.h>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "dynamicBuffer.hpp"
+#include "uploadRing.hpp"
+
+// Per-draw uniform blocks packed at minUniformBufferOffsetAlignment into one buffer.
+// Draws bind the buffer once with a dynamic offset binding and pick their block with the offset Push returned.
+class UniformArena {
+   public:
+    explicit UniformArena(const uint64_t initialSize);
+    ~UniformArena() = default;
+    UniformArena(const UniformArena &) = delete;
+    UniformArena(UniformArena &&) = delete;
+    auto operator=(const UniformArena &) -> UniformArena & = delete;
+    auto operator=(UniformArena &&) -> UniformArena & = delete;
+
+    auto Init(const wgpu::Device &device) -> bool;
+    // Returns the dynamic offset of the block, valid for this frame.
+    auto Push(const void *data, const uint64_t size) -> uint32_t;
+    template <typename T>
+    auto Push(const T &block) -> uint32_t {
+        return this->Push(&block, sizeof(T));
+    }
+    // Stages this frame's blocks in the ring, call before the ring is flushed.
+    void Flush(UploadRing &uploadRing);
+    auto GetBuffer() const -> wgpu::Buffer;
+    // Changes when the buffer is reallocated, bind groups built on the old one have to be recreated.
+    auto GetVersion() const -> uint32_t;
+
+   private:
+    std::vector<std::byte> blocks;
+    uint64_t alignment = 256;  // WebGPU default limit
+    uint32_t version = 0;
+    DynamicBuffer buffer;
+};
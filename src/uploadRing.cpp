@@ -0,0 +1,57 @@
+#include "uploadRing.hpp"
+#include <cstring>
+#include "profiler.hpp"
+
+namespace {
+// CopyBufferToBuffer offsets and sizes must be multiples of 4, keep 16 so vec4 data stays aligned.
+constexpr uint64_t uploadAlignment = 16;
+
+auto AlignUp(const uint64_t value, const uint64_t alignment) -> uint64_t {
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+}  // namespace
+
+UploadRing::UploadRing(const uint64_t initialCapacity) : stagingBuffer("upload_ring", wgpu::BufferUsage::CopySrc, initialCapacity) {
+    this->staging.reserve(initialCapacity);
+}
+
+auto UploadRing::Init(const wgpu::Device &device) -> bool {
+    return this->stagingBuffer.Init(device);
+}
+
+auto UploadRing::Allocate(const wgpu::Buffer &destination, const uint64_t destinationOffset, const uint64_t size) -> void * {
+    const uint64_t sourceOffset = AlignUp(this->used, uploadAlignment);
+    const uint64_t copySize = AlignUp(size, 4);
+
+    this->used = sourceOffset + copySize;
+    if (this->staging.size() < this->used) {
+        this->staging.resize(this->used);
+    }
+
+    this->copies.push_back(Copy{
+        .destination = destination,
+        .destinationOffset = destinationOffset,
+        .sourceOffset = sourceOffset,
+        .size = copySize,
+    });
+
+    return this->staging.data() + sourceOffset;
+}
+
+void UploadRing::Write(const wgpu::Buffer &destination, const uint64_t destinationOffset, const void *data, const uint64_t size) {
+    std::memcpy(this->Allocate(destination, destinationOffset, size), data, size);
+}
+
+void UploadRing::Flush(const wgpu::CommandEncoder &encoder, const wgpu::Queue &queue) {
+    ProfileScope profileScope("UploadRing::Flush");
+
+    if (this->used > 0 && this->stagingBuffer.Write(queue, this->staging.data(), this->used)) {
+        const wgpu::Buffer source = this->stagingBuffer.Get();
+        for (const auto &copy : this->copies) {
+            encoder.CopyBufferToBuffer(source, copy.sourceOffset, copy.destination, copy.destinationOffset, copy.size);
+        }
+    }
+
+    this->used = 0;
+    this->copies.clear();
+}
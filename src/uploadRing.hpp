@@ -0,0 +1,39 @@
+#pragma once
+#include <webgpu/webgpu_cpp.h>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "dynamicBuffer.hpp"
+
+// Collects a frame's uploads in one staging area, then Flush sends it with a single WriteBuffer
+// and scatters it to the destination buffers with copies on the GPU.
+class UploadRing {
+   public:
+    explicit UploadRing(const uint64_t initialCapacity);
+    ~UploadRing() = default;
+    UploadRing(const UploadRing &) = delete;
+    UploadRing(UploadRing &&) = delete;
+    auto operator=(const UploadRing &) -> UploadRing & = delete;
+    auto operator=(UploadRing &&) -> UploadRing & = delete;
+
+    auto Init(const wgpu::Device &device) -> bool;
+    // Memory to fill with size bytes, copied to destination on Flush.
+    // Only valid until the next Allocate, the staging area may move when it grows.
+    auto Allocate(const wgpu::Buffer &destination, const uint64_t destinationOffset, const uint64_t size) -> void *;
+    void Write(const wgpu::Buffer &destination, const uint64_t destinationOffset, const void *data, const uint64_t size);
+    // Encodes the copies, so it has to come before any pass reading the destinations.
+    void Flush(const wgpu::CommandEncoder &encoder, const wgpu::Queue &queue);
+
+   private:
+    struct Copy {
+        wgpu::Buffer destination;
+        uint64_t destinationOffset;
+        uint64_t sourceOffset;
+        uint64_t size;
+    };
+
+    std::vector<std::byte> staging;
+    uint64_t used = 0;
+    std::vector<Copy> copies;
+    DynamicBuffer stagingBuffer;
+};
@@ -0,0 +1,479 @@
+// Correctness checks for the platform-independent core, each one against a straightforward reference.
+// Registered with CTest, exits non-zero when any check fails. Timings live in Microbench.
+#include <glm/ext/matrix_transform.hpp>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <span>
+#include <tuple>
+#include <vector>
+#include "bvh.hpp"
+#include "camera.hpp"
+#include "cubeBatch.hpp"
+#include "drawQueue.hpp"
+#include "frustum.hpp"
+#include "instancePacking.hpp"
+#include "jobSystem.hpp"
+#include "mesh.hpp"
+#include "sceneLayout.hpp"
+
+namespace {
+// The batch builder has to match the per-instance glm path it replaces.
+auto VerifyInstanceMatrices() -> bool {
+    SceneLayout layout;
+    layout.BuildSphere(200.0f, 20, 30, 5.0f);
+    const glm::quat rotation = glm::angleAxis(glm::radians(37.0f), glm::normalize(glm::vec3(1, 2, 3)));
+
+    std::vector<glm::mat4x4> batch(layout.Size());
+    BuildInstanceMatrices(layout.GetPositions(), layout.GetScales(), rotation, batch);
+
+    float maxError = 0;
+    for (size_t i = 0; i < layout.Size(); ++i) {
+        const glm::mat4x4 reference = glm::translate(glm::mat4x4(1.0f), layout.GetPositions()[i])
+                                    * glm::mat4_cast(rotation)
+                                    * glm::scale(glm::mat4x4(1.0f), glm::vec3(layout.GetScales()[i]));
+        for (int column = 0; column < 4; ++column) {
+            for (int row = 0; row < 4; ++row) {
+                maxError = std::max(maxError, std::abs(batch[i][column][row] - reference[column][row]));
+            }
+        }
+    }
+
+    // Translations are up to 200, allow a few ulps at that magnitude.
+    std::printf("BuildInstanceMatrices max abs error vs glm: %g\n", maxError);
+    return maxError < 1e-4f;
+}
+
+// Packing a built matrix and unpacking it again has to give the matrix back, up to the Snorm16 rotation precision.
+// Rotations on both hemispheres of the quaternion cover the sign quat_cast picks, a negated quaternion is the same rotation.
+auto VerifyCompactRoundTrip() -> bool {
+    SceneLayout layout;
+    layout.BuildSphere(200.0f, 10, 20, 5.0f);
+    const std::vector<glm::quat> rotations{
+        glm::quat(1.0f, 0.0f, 0.0f, 0.0f),
+        glm::angleAxis(glm::radians(37.0f), glm::normalize(glm::vec3(1, 2, 3))),
+        glm::angleAxis(glm::radians(300.0f), glm::normalize(glm::vec3(-2, 1, 0.5f))),  // w < 0
+        glm::angleAxis(glm::radians(180.0f), glm::vec3(0, 1, 0)),                    // w = 0
+    };
+
+    float maxError = 0;
+    std::vector<glm::mat4x4> matrices(layout.Size());
+    for (const auto &rotation : rotations) {
+        const glm::quat negated(-rotation.w, -rotation.x, -rotation.y, -rotation.z);
+        BuildInstanceMatrices(layout.GetPositions(), layout.GetScales(), rotation, matrices);
+        for (size_t i = 0; i < layout.Size(); ++i) {
+            const glm::mat4x4 fromMatrix = UnpackCompactCubeInstance(PackCompactCubeInstance(matrices[i]));
+            const glm::mat4x4 fromNegated = UnpackCompactCubeInstance(PackCompactCubeInstance(layout.GetPositions()[i], negated, layout.GetScales()[i]));
+            for (int column = 0; column < 4; ++column) {
+                for (int row = 0; row < 4; ++row) {
+                    // Relative to the scale, which multiplies the quantization error of the rotation.
+                    const float scale = column < 3 ? layout.GetScales()[i] : 1.0f;
+                    maxError = std::max(maxError, std::abs(fromMatrix[column][row] - matrices[i][column][row]) / scale);
+                    maxError = std::max(maxError, std::abs(fromNegated[column][row] - matrices[i][column][row]) / scale);
+                }
+            }
+        }
+    }
+
+    // A few Snorm16 steps on each quaternion component.
+    std::printf("CompactCubeInstance round trip max error: %g\n", maxError);
+    return maxError < 5e-4f;
+}
+
+// The four-wide batch packer has to write exactly what packing each instance alone does, tail included.
+auto VerifyCompactBatch() -> bool {
+    SceneLayout layout;
+    layout.BuildSphere(200.0f, 20, 30, 5.0f);
+    const size_t count = layout.Size() - layout.Size() % 4 - 1;  // Not a multiple of four
+    const auto positions = std::span(layout.GetPositions()).first(count);
+    const auto scales = std::span(layout.GetScales()).first(count);
+    const glm::quat rotation = glm::angleAxis(glm::radians(37.0f), glm::normalize(glm::vec3(1, 2, 3)));
+
+    std::vector<CompactCubeInstance> batch(count);
+    PackCompactCubeInstances(positions, scales, rotation, batch);
+
+    bool valid = true;
+    for (size_t i = 0; i < count; ++i) {
+        const CompactCubeInstance expected = PackCompactCubeInstance(positions[i], rotation, scales[i]);
+        valid = valid && batch[i].translation == expected.translation && batch[i].scale == expected.scale && batch[i].rotation == expected.rotation;
+    }
+    std::printf("PackCompactCubeInstances vs per instance: %s\n", valid ? "ok" : "FAILED");
+    return valid;
+}
+
+// Back-face culling keeps counter-clockwise triangles, so every triangle has to wind counter-clockwise seen from outside,
+// agree with its vertex normals and face away from the center. Closed, the area-weighted face normals cancel out.
+auto VerifyMeshWinding() -> bool {
+    auto checkMesh = [](const MeshData &mesh, const bool closed) {
+        bool valid = !mesh.indices.empty() && mesh.indices.size() % 3 == 0;
+        glm::vec3 areaSum(0.0f);
+        for (size_t i = 0; i + 2 < mesh.indices.size() && valid; i += 3) {
+            valid = mesh.indices[i] < mesh.vertices.size() && mesh.indices[i + 1] < mesh.vertices.size() && mesh.indices[i + 2] < mesh.vertices.size();
+            if (!valid) {
+                break;
+            }
+            const MeshVertex &a = mesh.vertices[mesh.indices[i]];
+            const MeshVertex &b = mesh.vertices[mesh.indices[i + 1]];
+            const MeshVertex &c = mesh.vertices[mesh.indices[i + 2]];
+            const glm::vec3 faceNormal = glm::cross(b.position - a.position, c.position - a.position);
+            const glm::vec3 centroid = (a.position + b.position + c.position) / 3.0f;
+            areaSum += faceNormal;
+            for (const MeshVertex *vertex : {&a, &b, &c}) {
+                valid = valid && std::abs(glm::length(vertex->normal) - 1.0f) < 1e-5f && glm::dot(glm::normalize(faceNormal), vertex->normal) > 0.999f;
+            }
+            valid = valid && (!closed || glm::dot(faceNormal, centroid) > 0.0f);
+        }
+        return valid && (!closed || glm::length(areaSum) < 1e-4f);
+    };
+
+    const MeshData cube = BuildCubeMesh();
+    const MeshData impostor = BuildImpostorMesh(cube);
+    const bool valid = checkMesh(cube, true) && checkMesh(impostor, false) && impostor.vertices[0].normal == glm::vec3(0.0f, 0.0f, 1.0f);
+    std::printf("Mesh winding and normals: %s\n", valid ? "ok" : "FAILED");
+    return valid;
+}
+
+// Every index has to be visited exactly once, however the chunks end up stolen.
+auto VerifyJobSystem() -> bool {
+    JobSystem jobSystem(std::max<size_t>(JobSystem::DefaultWorkerCount(), 3));
+    std::vector<std::atomic<int>> visits(100003);
+
+    for (int round = 0; round < 50; ++round) {
+        jobSystem.ParallelFor(visits.size(), 1000, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                visits[i].fetch_add(1, std::memory_order_relaxed);
+            }
+        });
+    }
+
+    const bool valid = std::all_of(visits.begin(), visits.end(), [](const std::atomic<int> &count) { return count.load() == 50; });
+    std::printf("JobSystem ParallelFor with %zu workers: %s\n", jobSystem.GetWorkerCount(), valid ? "ok" : "FAILED");
+    return valid;
+}
+
+// Interleaved submissions have to come out as one draw per pipeline and mesh, in order, with instances grouped to match.
+auto VerifyDrawQueue() -> bool {
+    struct Submitted {
+        uint32_t pipeline;
+        uint32_t mesh;
+        std::vector<uint32_t> instances;
+    };
+    const std::vector<Submitted> submitted{
+        {1, 0, {100, 101}},
+        {0, 2, {200}},
+        {0, 1, {300, 301, 302}},
+        {1, 0, {102}},
+        {0, 2, {201, 202}},
+    };
+
+    DrawQueue drawQueue(sizeof(uint32_t));
+    for (const auto &submission : submitted) {
+        drawQueue.Submit(submission.pipeline, submission.mesh, std::as_bytes(std::span(submission.instances)));
+    }
+
+    std::vector<uint32_t> instances(drawQueue.GetInstanceBytes() / sizeof(uint32_t));
+    const auto &commands = drawQueue.Build(reinterpret_cast<std::byte *>(instances.data()));
+
+    const std::vector<DrawCommand> expectedCommands{{0, 1, 0, 3}, {0, 2, 3, 3}, {1, 0, 6, 3}};
+    const std::vector<uint32_t> expectedInstances{300, 301, 302, 200, 201, 202, 100, 101, 102};
+    const bool valid = instances == expectedInstances
+                    && std::equal(commands.begin(), commands.end(), expectedCommands.begin(), expectedCommands.end(), [](const DrawCommand &a, const DrawCommand &b) {
+                           return a.pipeline == b.pipeline && a.mesh == b.mesh && a.firstInstance == b.firstInstance && a.instanceCount == b.instanceCount;
+                       });
+    std::printf("DrawQueue sort and merge: %s\n", valid ? "ok" : "FAILED");
+    return valid;
+}
+
+// Reverse-Z has to map the near plane to 1, keep depth positive and decreasing out to huge distances,
+// and its frustum must still keep far spheres and drop the ones behind the camera.
+auto VerifyReverseZ() -> bool {
+    Camera camera;
+    camera.SetReverseZ(true);
+    camera.Init(1920, 1080, glm::vec3(0.0f));
+    const glm::mat4x4 viewProjectionMatrix = camera.GetProjectionMatrix() * camera.GetViewMatrix();
+
+    auto depthAt = [&](const float distance) {
+        const glm::vec4 clip = viewProjectionMatrix * glm::vec4(0.0f, 0.0f, -distance, 1.0f);
+        return clip.z / clip.w;
+    };
+    const Frustum frustum = ExtractFrustum(viewProjectionMatrix);
+
+    const bool valid = std::abs(depthAt(0.1f) - 1.0f) < 1e-6f
+                    && depthAt(1000.0f) > depthAt(1001.0f)
+                    && depthAt(1e7f) > 0.0f
+                    && IsSphereInFrustum(frustum, glm::vec3(0.0f, 0.0f, -1e6f), 1.0f)
+                    && !IsSphereInFrustum(frustum, glm::vec3(0.0f, 0.0f, 10.0f), 1.0f);
+    std::printf("Reverse-Z infinite projection: %s\n", valid ? "ok" : "FAILED");
+    return valid;
+}
+
+// The CPU reference has to keep exactly the instances cube_cull.wgsl appends, whatever order the GPU appends them in.
+// The shader's rule is transcribed here plane by plane, including the abs of a mirrored (negative) scale.
+auto VerifyAnimatedCull() -> bool {
+    std::mt19937 random(2);
+    std::uniform_real_distribution<float> position(-300.0f, 300.0f);
+    std::uniform_real_distribution<float> scale(-8.0f, 8.0f);
+    std::vector<AnimatedCubeInstance> instances(20000);
+    for (auto &instance : instances) {
+        instance = AnimatedCubeInstance{
+            .position = glm::vec3(position(random), position(random), position(random)),
+            .scale = scale(random),
+            .rotationAxis = glm::vec3(0.0f, 1.0f, 0.0f),
+            .rotationSpeed = 1.0f,
+        };
+    }
+
+    Camera camera;
+    camera.Init(1920, 1080, glm::vec3(0.0f, 0.0f, 150.0f));
+    const Frustum frustum = ExtractFrustum(camera.GetProjectionMatrix() * camera.GetViewMatrix());
+
+    bool valid = true;
+    for (const float boundingRadius : {cubeBoundingRadius, 0.5f}) {
+        std::vector<glm::vec3> expected;
+        for (const auto &instance : instances) {
+            const float radius = std::abs(instance.scale) * boundingRadius;
+            bool visible = true;
+            for (const auto &plane : frustum.planes) {
+                visible = visible && !(glm::dot(glm::vec3(plane), instance.position) + plane.w < -radius);
+            }
+            if (visible) {
+                expected.push_back(instance.position);
+            }
+        }
+
+        std::vector<AnimatedCubeInstance> visibleInstances;
+        const size_t visibleCount = CullAnimatedCubeInstances(frustum, instances, visibleInstances, boundingRadius);
+        std::vector<glm::vec3> culled;
+        for (const auto &instance : visibleInstances) {
+            culled.push_back(instance.position);
+        }
+
+        auto byPosition = [](const glm::vec3 &a, const glm::vec3 &b) { return std::tie(a.x, a.y, a.z) < std::tie(b.x, b.y, b.z); };
+        std::sort(expected.begin(), expected.end(), byPosition);
+        std::sort(culled.begin(), culled.end(), byPosition);
+        valid = valid && visibleCount == visibleInstances.size() && culled == expected && !expected.empty() && expected.size() < instances.size();
+    }
+    std::printf("Animated cube cull vs cube_cull.wgsl rule: %s\n", valid ? "ok" : "FAILED");
+    return valid;
+}
+
+// Sorted depths may only go backwards within one 16-bit quantization step of the batch's depth range.
+auto VerifyFrontToBackSort() -> bool {
+    SceneLayout layout;
+    layout.BuildSphere(200.0f, 125, 250, 5.0f);
+    Camera camera;
+    camera.Init(1920, 1080, glm::vec3(0.0f, 0.0f, 150.0f));
+    const glm::mat4x4 viewProjectionMatrix = camera.GetProjectionMatrix() * camera.GetViewMatrix();
+
+    CubeBatch batch(CubeInstanceFormat::ModelMatrix, layout.Size());
+    batch.Add(layout.GetPositions(), layout.GetScales(), glm::quat(1.0f, 0.0f, 0.0f, 0.0f));
+    batch.SortFrontToBack(viewProjectionMatrix);
+
+    std::vector<float> depths;
+    for (const auto &transform : batch.GetModelMatrices()) {
+        depths.push_back((viewProjectionMatrix * transform[3]).w);
+    }
+    const auto [minDepth, maxDepth] = std::minmax_element(depths.begin(), depths.end());
+    const float step = (*maxDepth - *minDepth) / 65535.0f * 1.01f;
+    bool valid = batch.Size() == layout.Size();
+    for (size_t i = 1; i < depths.size(); ++i) {
+        valid &= depths[i] >= depths[i - 1] - step;
+    }
+    std::printf("CubeBatch front-to-back sort: %s\n", valid ? "ok" : "FAILED");
+    return valid;
+}
+
+// Instances at increasing distance have to land in the level matching their projected diameter.
+auto VerifyLodSplit() -> bool {
+    Camera camera;
+    camera.Init(1920, 1080, glm::vec3(0.0f));
+    const glm::mat4x4 viewProjectionMatrix = camera.GetProjectionMatrix() * camera.GetViewMatrix();
+    const float screenScale = GetScreenScale(camera.GetProjectionMatrix(), 1080.0f);
+
+    // A unit bounding radius at these distances covers 2 * screenScale / distance pixels.
+    const std::vector<float> distances{10.0f, 100.0f, 1000.0f, 10000.0f};
+    CubeBatch batch(CubeInstanceFormat::Compact, distances.size());
+    for (const float distance : distances) {
+        batch.Add(glm::vec3(0.0f, 0.0f, -distance), glm::quat(1.0f, 0.0f, 0.0f, 0.0f), 1.0f);
+    }
+
+    CubeBatch medium(CubeInstanceFormat::Compact, 0);
+    CubeBatch impostor(CubeInstanceFormat::Compact, 0);
+    const std::array<float, 2> maxScreenSizes{2.0f * screenScale / 50.0f, 2.0f * screenScale / 500.0f};
+    const std::array<CubeBatch *, 2> levels{&medium, &impostor};
+    batch.SplitByScreenSize(viewProjectionMatrix, screenScale, 1.0f, maxScreenSizes, levels);
+
+    const bool valid = batch.Size() == 1 && batch.GetCompactInstances()[0].translation.z == -10.0f
+                    && medium.Size() == 1 && medium.GetCompactInstances()[0].translation.z == -100.0f
+                    && impostor.Size() == 2;
+    std::printf("CubeBatch LOD split: %s\n", valid ? "ok" : "FAILED");
+    return valid;
+}
+
+// Entry distance of a ray into a sphere's bounding box, the linear reference for Bvh::Raycast.
+auto RaycastSphereBox(const glm::vec3 origin, const glm::vec3 direction, const glm::vec4 sphere) -> float {
+    float enter = 0.0f;
+    float exit = INFINITY;
+    for (int axis = 0; axis < 3; ++axis) {
+        const float t0 = (sphere[axis] - sphere.w - origin[axis]) / direction[axis];
+        const float t1 = (sphere[axis] + sphere.w - origin[axis]) / direction[axis];
+        enter = std::max(enter, std::min(t0, t1));
+        exit = std::min(exit, std::max(t0, t1));
+    }
+    return enter <= exit ? enter : INFINITY;
+}
+
+auto RaycastLinear(std::span<const glm::vec4> spheres, const glm::vec3 origin, const glm::vec3 direction) -> float {
+    float nearest = INFINITY;
+    for (const auto &sphere : spheres) {
+        nearest = std::min(nearest, RaycastSphereBox(origin, direction, sphere));
+    }
+    return nearest;
+}
+
+// Every query has to match a linear scan, items are compared by distance since ties may pick either.
+auto VerifyBvh() -> bool {
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> position(-200.0f, 200.0f);
+    std::uniform_real_distribution<float> radius(0.1f, 5.0f);
+    std::vector<glm::vec4> spheres(10000);
+    for (auto &sphere : spheres) {
+        sphere = glm::vec4(position(random), position(random), position(random), radius(random));
+    }
+    // A few coincident items so the builder has to fall back to a leaf.
+    for (size_t i = 0; i < 8; ++i) {
+        spheres[i] = glm::vec4(1.0f, 2.0f, 3.0f, 1.0f);
+    }
+
+    Bvh bvh;
+    bvh.Build(spheres);
+    bool valid = bvh.Size() == spheres.size();
+
+    Camera camera;
+    camera.Init(1920, 1080, glm::vec3(0.0f));
+    const Frustum frustum = ExtractFrustum(camera.GetProjectionMatrix() * camera.GetViewMatrix());
+    std::vector<uint32_t> items;
+    bvh.QueryFrustum(frustum, items);
+    std::sort(items.begin(), items.end());
+    std::vector<uint32_t> expectedItems;
+    for (uint32_t i = 0; i < spheres.size(); ++i) {
+        if (IsSphereInFrustum(frustum, glm::vec3(spheres[i]), spheres[i].w)) {
+            expectedItems.push_back(i);
+        }
+    }
+    valid = valid && items == expectedItems;
+
+    // The tree multiplies by the inverse direction where the reference divides, so distances differ in the last bits.
+    auto near = [](const float a, const float b) { return a == b || std::abs(a - b) <= 1e-5f * std::max(a, b); };
+    for (int query = 0; query < 200 && valid; ++query) {
+        const glm::vec3 origin(position(random), position(random), position(random));
+        const glm::vec3 direction = glm::normalize(glm::vec3(position(random), position(random), position(random)));
+        const BvhHit hit = bvh.Raycast(origin, direction);
+        const float expectedDistance = RaycastLinear(spheres, origin, direction);
+        valid = near(hit.distance, expectedDistance)
+             && (hit.item == BvhHit::noItem || near(RaycastSphereBox(origin, direction, spheres[hit.item]), hit.distance));
+
+        float expectedNearest = INFINITY;
+        for (const auto &sphere : spheres) {
+            expectedNearest = std::min(expectedNearest, glm::length(glm::vec3(sphere) - origin));
+        }
+        valid = valid && bvh.FindNearest(origin).distance == expectedNearest && bvh.FindNearest(origin, expectedNearest * 0.5f).item == BvhHit::noItem;
+    }
+
+    // Moved items are found at their new place after a refit.
+    for (auto &sphere : spheres) {
+        sphere.z += 1000.0f;
+    }
+    bvh.Refit(spheres);
+    const BvhHit moved = bvh.Raycast(glm::vec3(spheres[100]) - glm::vec3(0.0f, 0.0f, 50.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+    valid = valid && moved.item != BvhHit::noItem && moved.distance <= 50.0f;
+
+    std::printf("Bvh queries: %s\n", valid ? "ok" : "FAILED");
+    return valid;
+}
+
+// A tree built on the job system makes the same splits as one built on the calling thread, only numbered differently,
+// so every query has to return the same item, and a refit has to find the parents after their children.
+auto VerifyBvhJobs() -> bool {
+    std::mt19937 random(2);
+    std::uniform_real_distribution<float> position(-200.0f, 200.0f);
+    std::uniform_real_distribution<float> radius(0.1f, 5.0f);
+    std::vector<glm::vec4> spheres(100000);
+    for (auto &sphere : spheres) {
+        sphere = glm::vec4(position(random), position(random), position(random), radius(random));
+    }
+
+    JobSystem jobSystem(std::max<size_t>(JobSystem::DefaultWorkerCount(), 3));
+    Bvh serial;
+    serial.Build(spheres);
+    Bvh threaded;
+    threaded.SetJobSystem(&jobSystem);
+    threaded.Build(spheres);
+    bool valid = threaded.GetNodeCount() == serial.GetNodeCount();
+
+    for (auto &sphere : spheres) {
+        sphere.z += 1000.0f;
+    }
+    serial.Refit(spheres);
+    threaded.Refit(spheres);
+    for (int query = 0; query < 200 && valid; ++query) {
+        const glm::vec3 origin(position(random), position(random), position(random) + 1000.0f);
+        const glm::vec3 direction = glm::normalize(glm::vec3(position(random), position(random), position(random)));
+        const BvhHit expected = serial.Raycast(origin, direction);
+        const BvhHit hit = threaded.Raycast(origin, direction);
+        valid = hit.item == expected.item && hit.distance == expected.distance && threaded.FindNearest(origin).item == serial.FindNearest(origin).item;
+    }
+
+    std::printf("Bvh build with %zu workers: %s\n", jobSystem.GetWorkerCount(), valid ? "ok" : "FAILED");
+    return valid;
+}
+
+// A pixel unprojected with GetPointerRay has to lead back to the point projected onto it, with either depth mapping.
+auto VerifyPointerRay() -> bool {
+    const glm::vec2 viewportSize(1920.0f, 1080.0f);
+    bool valid = true;
+    for (const bool reverseZ : {false, true}) {
+        Camera camera;
+        camera.SetReverseZ(reverseZ);
+        camera.Init(1920, 1080, glm::vec3(3.0f, -2.0f, 5.0f));
+        camera.ProcessMouseMovement(40, -25);
+        const glm::mat4x4 viewMatrix = camera.GetViewMatrix();
+        const glm::mat4x4 projectionMatrix = camera.GetProjectionMatrix();
+
+        const glm::vec3 target = glm::vec3(glm::inverse(viewMatrix) * glm::vec4(12.0f, -7.0f, -60.0f, 1.0f));
+        const glm::vec4 clip = projectionMatrix * viewMatrix * glm::vec4(target, 1.0f);
+        const glm::vec2 pointer((clip.x / clip.w * 0.5f + 0.5f) * viewportSize.x, (0.5f - clip.y / clip.w * 0.5f) * viewportSize.y);
+        const Ray ray = GetPointerRay(viewMatrix, projectionMatrix, pointer, viewportSize);
+
+        const glm::vec3 offset = target - ray.origin;
+        const glm::vec3 closest = ray.origin + ray.direction * glm::dot(offset, ray.direction);
+        valid = valid && glm::length(closest - target) < 1e-3f && glm::dot(offset, ray.direction) > 0.0f;
+
+        // Picking the target out of a crowd of items placed around it.
+        std::vector<glm::vec4> spheres;
+        for (int i = -50; i <= 50; ++i) {
+            spheres.emplace_back(target.x + (float)i * 3.0f, target.y, target.z, 1.0f);
+        }
+        Bvh bvh;
+        bvh.Build(spheres);
+        valid = valid && bvh.Raycast(ray.origin, ray.direction).item == 50;
+    }
+    std::printf("Pointer ray picking: %s\n", valid ? "ok" : "FAILED");
+    return valid;
+}
+}  // namespace
+
+auto main() -> int {
+    // Every check runs and reports, so one failure does not hide the others.
+    bool valid = true;
+    for (const auto check : {VerifyInstanceMatrices, VerifyCompactRoundTrip, VerifyCompactBatch, VerifyMeshWinding, VerifyJobSystem, VerifyDrawQueue, VerifyReverseZ, VerifyAnimatedCull, VerifyFrontToBackSort, VerifyLodSplit, VerifyBvh, VerifyBvhJobs, VerifyPointerRay}) {
+        valid &= check();
+    }
+    return valid ? EXIT_SUCCESS : EXIT_FAILURE;
+}